@@ -1,11 +1,14 @@
 #version 330 core
 
-uniform vec3 uPosition;
+// Position of each slot's primary, indexed by slot
+uniform samplerBuffer uPrimaryPositions;
+uniform int uPointsPerOrbit;
 uniform mat4 uView;
 uniform mat4 uProjection;
 
 layout(location = 0) in vec3 aPos;
 
 void main() {
-    gl_Position = uProjection * (uView * vec4(uPosition + aPos, 1.0));
+    vec3 primary = texelFetch(uPrimaryPositions, gl_VertexID / uPointsPerOrbit).xyz;
+    gl_Position = uProjection * (uView * vec4(primary + aPos, 1.0));
 }
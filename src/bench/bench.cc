@@ -0,0 +1,129 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+#include "model/solar_system.h"
+
+namespace sfs::bench {
+
+bool BenchRunner::enabled(const std::string &name) const {
+    return options_.filter.empty() || name.find(options_.filter) != std::string::npos;
+}
+
+void BenchRunner::run(const std::string &name, const std::string &params, const std::function<void()> &op, const BenchCounters &counters) {
+    if (!enabled(name)) return;
+
+    // Warm up caches and branch predictors before measuring. Ops that are already
+    // slower than the minimum time are not repeated.
+    auto warmupStart = std::chrono::steady_clock::now();
+    op();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - warmupStart).count();
+
+    long long ops = 1;
+    while (seconds < options_.minTime) {
+        auto start = std::chrono::steady_clock::now();
+        for (long long i = 0; i < ops; i++) op();
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (seconds >= options_.minTime) break;
+
+        // Aim slightly past the minimum time so that the next round is usually the last
+        double scale = seconds > 0.0 ? 1.4 * options_.minTime / seconds : 10.0;
+        ops = static_cast<long long>(static_cast<double>(ops) * std::clamp(scale, 2.0, 100.0));
+    }
+
+    double secondsPerOp = seconds / static_cast<double>(ops);
+    results_.push_back(BenchResult{
+            .name = name,
+            .params = params,
+            .ops = ops,
+            .nsPerOp = secondsPerOp * 1e9,
+            .itemsPerSecond = counters.items / secondsPerOp,
+            .avgIterations = counters.avgIterations,
+            .workingSetBytes = counters.workingSetBytes,
+            .rmsRelativeError = counters.rmsRelativeError,
+            .maxRelativeError = counters.maxRelativeError,
+    });
+    std::cerr << name << " [" << params << "]: " << secondsPerOp * 1e9 << " ns/op" << std::endl;
+}
+
+void BenchRunner::report() const {
+    std::cout << std::setprecision(6);
+    if (options_.format == "json") {
+        std::cout << "[" << std::endl;
+        for (size_t i = 0; i < results_.size(); i++) {
+            const auto &r = results_[i];
+            std::cout << "  {\"name\": \"" << r.name << "\", \"params\": \"" << r.params << "\", \"ops\": " << r.ops
+                      << ", \"ns_per_op\": " << r.nsPerOp << ", \"items_per_sec\": " << r.itemsPerSecond
+                      << ", \"avg_iterations\": " << r.avgIterations << ", \"working_set_bytes\": " << r.workingSetBytes
+                      << ", \"rms_rel_error\": " << r.rmsRelativeError << ", \"max_rel_error\": " << r.maxRelativeError << "}"
+                      << (i + 1 < results_.size() ? "," : "") << std::endl;
+        }
+        std::cout << "]" << std::endl;
+    } else {
+        std::cout << "name,params,ops,ns_per_op,items_per_sec,avg_iterations,working_set_bytes,rms_rel_error,max_rel_error" << std::endl;
+        for (const auto &r : results_) {
+            std::cout << r.name << "," << r.params << "," << r.ops << "," << r.nsPerOp << "," << r.itemsPerSecond << ","
+                      << r.avgIterations << "," << r.workingSetBytes << "," << r.rmsRelativeError << "," << r.maxRelativeError << std::endl;
+        }
+    }
+}
+
+void createBenchScene(entt::registry &registry, int count) {
+    auto sun = model::createSolarSystem(registry);
+    model::createAsteroidBelt(registry, sun, count, 42);
+}
+
+} // namespace sfs::bench
+
+namespace {
+
+void printUsage(const char *program) {
+    std::cerr << "Usage: " << program << " [--format csv|json] [--filter NAME] [--min-time SECONDS] [--max-bodies N] [--max-threads N]" << std::endl;
+}
+
+bool parseOptions(int argc, char **argv, sfs::bench::BenchOptions &options) {
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!value) return false;
+        if (std::strcmp(arg, "--format") == 0) {
+            options.format = value;
+        } else if (std::strcmp(arg, "--filter") == 0) {
+            options.filter = value;
+        } else if (std::strcmp(arg, "--min-time") == 0) {
+            options.minTime = std::strtod(value, nullptr);
+        } else if (std::strcmp(arg, "--max-bodies") == 0) {
+            options.maxBodies = std::atoi(value);
+        } else if (std::strcmp(arg, "--max-threads") == 0) {
+            options.maxThreads = static_cast<unsigned>(std::strtoul(value, nullptr, 10));
+        } else {
+            return false;
+        }
+        i++;
+    }
+    return options.format == "csv" || options.format == "json";
+}
+
+} // namespace
+
+// Microbenchmarks for the physics hot paths. Results go to stdout as CSV or JSON so
+// runs can be diffed across commits; progress goes to stderr.
+int main(int argc, char **argv) {
+    sfs::bench::BenchOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    sfs::bench::BenchRunner runner(options);
+    sfs::bench::runKeplerBenchmarks(runner);
+    sfs::bench::runGravityBenchmarks(runner);
+    sfs::bench::runScalingBenchmarks(runner);
+    runner.report();
+    return 0;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <entt/entt.hpp>
+
+namespace sfs::bench {
+
+struct BenchOptions {
+    std::string format = "csv";  // "csv" or "json"
+    std::string filter;          // Only run benchmarks whose name contains this
+    double minTime = 0.2;        // Minimum measured wall time per benchmark, in seconds
+    int maxBodies = 100000;
+    unsigned maxThreads = 0;     // Upper end of the thread scaling runs, 0 for one per hardware thread
+};
+
+// Per-operation counters reported alongside the timing
+struct BenchCounters {
+    double items = 1.0;          // Work items (bodies, pairs, points) processed per op
+    double avgIterations = 0.0;  // Average solver iterations per item, if applicable
+    double workingSetBytes = 0.0;
+    double rmsRelativeError = 0.0;  // Against a reference result, for approximations
+    double maxRelativeError = 0.0;
+};
+
+struct BenchResult {
+    std::string name;
+    std::string params;
+    long long ops;
+    double nsPerOp;
+    double itemsPerSecond;
+    double avgIterations;
+    double workingSetBytes;
+    double rmsRelativeError;
+    double maxRelativeError;
+};
+
+class BenchRunner {
+public:
+    explicit BenchRunner(BenchOptions options) : options_(std::move(options)) { }
+
+    const BenchOptions &options() const { return options_; }
+    bool enabled(const std::string &name) const;
+
+    // Repeats `op` until at least `minTime` seconds have been measured
+    void run(const std::string &name, const std::string &params, const std::function<void()> &op, const BenchCounters &counters = { });
+
+    void report() const;
+
+private:
+    BenchOptions options_;
+    std::vector<BenchResult> results_;
+};
+
+template<typename T>
+inline void doNotOptimize(const T &value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Solar system with `count` asteroids added, so that the scene has roughly `count + 10` bodies
+void createBenchScene(entt::registry &registry, int count);
+
+void runKeplerBenchmarks(BenchRunner &runner);
+void runGravityBenchmarks(BenchRunner &runner);
+void runScalingBenchmarks(BenchRunner &runner);
+
+} // namespace sfs::bench
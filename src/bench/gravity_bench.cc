@@ -0,0 +1,116 @@
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include <entt/entt.hpp>
+
+#include "bench/bench.h"
+#include "physics/barnes_hut.h"
+#include "physics/body_arrays.h"
+#include "physics/gravity_kernels.h"
+#include "physics/physics.h"
+
+namespace sfs::bench {
+
+namespace {
+
+void clearAccelerations(physics::BodyArrays &arrays) {
+    std::fill(arrays.gx.begin(), arrays.gx.end(), 0.0);
+    std::fill(arrays.gy.begin(), arrays.gy.end(), 0.0);
+    std::fill(arrays.gz.begin(), arrays.gz.end(), 0.0);
+}
+
+// Compares the accelerations currently in gx/gy/gz against `reference`, per body
+void measureError(const physics::BodyArrays &arrays, const std::vector<double> &reference, BenchCounters &counters) {
+    double sumSquared = 0.0, worst = 0.0;
+    size_t count = 0;
+    for (size_t i = 0; i < arrays.size(); i++) {
+        double rx = reference[3 * i], ry = reference[3 * i + 1], rz = reference[3 * i + 2];
+        double norm = std::sqrt(rx * rx + ry * ry + rz * rz);
+        if (norm == 0.0) continue;
+        double dx = arrays.gx[i] - rx, dy = arrays.gy[i] - ry, dz = arrays.gz[i] - rz;
+        double error = std::sqrt(dx * dx + dy * dy + dz * dz) / norm;
+        sumSquared += error * error;
+        worst = std::max(worst, error);
+        count++;
+    }
+    counters.rmsRelativeError = count > 0 ? std::sqrt(sumSquared / count) : 0.0;
+    counters.maxRelativeError = worst;
+}
+
+void benchBarnesHut(BenchRunner &runner) {
+    if (!runner.enabled("barnes_hut")) return;
+
+    constexpr double kThetas[] = { 0.3, 0.5, 0.8 };
+    for (int bodies = 1000; bodies <= runner.options().maxBodies; bodies *= 10) {
+        entt::registry registry;
+        createBenchScene(registry, bodies - 10);
+        auto &arrays = physics::gatherBodyArrays(registry);
+
+        // The direct sum is the reference for the accuracy report
+        clearAccelerations(arrays);
+        physics::accumulatePairwiseGravity(arrays, physics::bestGravityKernel());
+        std::vector<double> reference(3 * arrays.size());
+        for (size_t i = 0; i < arrays.size(); i++) {
+            reference[3 * i] = arrays.gx[i], reference[3 * i + 1] = arrays.gy[i], reference[3 * i + 2] = arrays.gz[i];
+        }
+
+        physics::BarnesHutTree tree;
+        for (double theta : kThetas) {
+            BenchCounters counters;
+            counters.items = bodies;
+            counters.workingSetBytes = bodies * 7 * sizeof(double);
+            physics::buildBarnesHutTree(arrays, tree);
+            clearAccelerations(arrays);
+            physics::accumulateBarnesHutGravity(arrays, tree, theta);
+            measureError(arrays, reference, counters);
+            counters.workingSetBytes += tree.nodes.size() * sizeof(physics::BarnesHutNode);
+
+            std::string params = "bodies=" + std::to_string(bodies) + ";theta=" + std::to_string(theta).substr(0, 3);
+            runner.run("barnes_hut", params, [&] {
+                physics::buildBarnesHutTree(arrays, tree);
+                clearAccelerations(arrays);
+                physics::accumulateBarnesHutGravity(arrays, tree, theta);
+            }, counters);
+        }
+    }
+}
+
+void benchDirectSum(BenchRunner &runner) {
+    if (!runner.enabled("gravity_system")) return;
+
+    constexpr physics::GravityKernel kKernels[] = {
+        physics::GravityKernel::Scalar,
+        physics::GravityKernel::Avx2,
+        physics::GravityKernel::Avx512,
+    };
+
+    for (int bodies = 10; bodies <= runner.options().maxBodies; bodies *= 10) {
+        entt::registry registry;
+        createBenchScene(registry, bodies - 10);
+        auto &arrays = physics::gatherBodyArrays(registry);
+
+        // Items are ordered body pairs, so items/sec stays comparable across body counts
+        // and kernels, while the working set (absolute position, mass and acceleration
+        // per body) shows where the scene stops fitting in cache.
+        BenchCounters counters;
+        counters.items = static_cast<double>(bodies) * static_cast<double>(bodies - 1);
+        counters.workingSetBytes = bodies * 7 * sizeof(double);
+        for (auto kernel : kKernels) {
+            if (!physics::isGravityKernelSupported(kernel)) continue;
+            std::string params = "bodies=" + std::to_string(bodies) + ";kernel=" + physics::gravityKernelName(kernel);
+            runner.run("gravity_system", params, [&] {
+                physics::gravitySystem(arrays, kernel);
+            }, counters);
+        }
+    }
+}
+
+} // namespace
+
+void runGravityBenchmarks(BenchRunner &runner) {
+    benchDirectSum(runner);
+    benchBarnesHut(runner);
+}
+
+} // namespace sfs::bench
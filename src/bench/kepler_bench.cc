@@ -0,0 +1,242 @@
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <entt/entt.hpp>
+
+#include "bench/bench.h"
+#include "physics/body_arrays.h"
+#include "physics/kepler.h"
+#include "physics/kepler_batch.h"
+#include "physics/physics.h"
+
+namespace sfs::bench {
+
+namespace {
+
+constexpr double kSunMu = physics::kGravitationalConstant * 1.98841e30;
+constexpr double kPeriapse = 1.496e11;  // 1 AU
+constexpr int kOrbitSamples = 256;
+
+struct Regime {
+    const char *name;
+    double e;
+};
+
+constexpr Regime kRegimes[] = {
+    { "circular", 1e-3 },
+    { "elliptic_high_e", 0.95 },
+    { "near_parabolic", 0.999 },
+    { "hyperbolic", 1.5 },
+};
+
+constexpr double kDts[] = { 60.0, 3600.0, 86400.0, 2.6e6 };
+
+// Builds states spread along a conic with the given eccentricity and periapse, so that
+// the solver does not see the same input every call.
+std::vector<physics::KeplerParameters> makeOrbitSamples(double e) {
+    double semiLatus = kPeriapse * (1.0 + e);
+    double maxAnomaly = e < 1.0 ? M_PI : 0.9 * acos(-1.0 / e);
+
+    std::vector<physics::KeplerParameters> samples;
+    samples.reserve(kOrbitSamples);
+    for (int i = 0; i < kOrbitSamples; i++) {
+        double nu = -maxAnomaly + 2.0 * maxAnomaly * (i + 0.5) / kOrbitSamples;
+        double r = semiLatus / (1.0 + e * cos(nu));
+        Eigen::Vector3d r0(r * cos(nu), 0.0, r * sin(nu));
+        Eigen::Vector3d v0 = sqrt(kSunMu / semiLatus) * Eigen::Vector3d(-sin(nu), 0.0, e + cos(nu));
+        samples.push_back(physics::calculateKeplerParameters(r0, v0, kSunMu));
+    }
+    return samples;
+}
+
+std::string formatParams(const char *regime, double dt) {
+    std::ostringstream ss;
+    ss << "regime=" << regime << ";dt=" << dt;
+    return ss.str();
+}
+
+std::string formatBodies(int bodies) {
+    return "bodies=" + std::to_string(bodies);
+}
+
+void benchSolveUniversalKeplerEquation(BenchRunner &runner) {
+    if (!runner.enabled("kepler_solve")) return;
+
+    for (const auto &regime : kRegimes) {
+        auto samples = makeOrbitSamples(regime.e);
+        for (double dt : kDts) {
+            long long totalIterations = 0;
+            for (const auto &p : samples) {
+                int iterations;
+                physics::solveUniversalKeplerEquation(p, dt, nullptr, nullptr, &iterations);
+                totalIterations += iterations;
+            }
+
+            BenchCounters counters;
+            counters.items = kOrbitSamples;
+            counters.avgIterations = static_cast<double>(totalIterations) / kOrbitSamples;
+            counters.workingSetBytes = kOrbitSamples * sizeof(physics::KeplerParameters);
+            runner.run("kepler_solve", formatParams(regime.name, dt), [&] {
+                for (const auto &p : samples) {
+                    double C, S;
+                    double chi = physics::solveUniversalKeplerEquation(p, dt, &C, &S);
+                    doNotOptimize(chi);
+                }
+            }, counters);
+        }
+    }
+}
+
+// Steady run from each sample's epoch, the way keplerPropagationSystem drives the solver
+// for unperturbed orbits: each step solves every orbit in one batch. Warm starts continue
+// from the previous step's solution. Compare ns/op as well as iterations: the Taylor step
+// runs scalar, so it only pays for itself where it saves whole batch iterations.
+void benchWarmStart(BenchRunner &runner) {
+    if (!runner.enabled("kepler_warm_start")) return;
+
+    constexpr int kSteps = 8;
+    for (const auto &regime : kRegimes) {
+        auto samples = makeOrbitSamples(regime.e);
+        std::vector<const physics::KeplerParameters *> params;
+        for (const auto &p : samples) params.push_back(&p);
+        std::vector<double> dts(kOrbitSamples), guess(kOrbitSamples), chi(kOrbitSamples), C(kOrbitSamples), S(kOrbitSamples);
+        std::vector<int> iterations(kOrbitSamples);
+        std::vector<Eigen::Vector3d> r(kOrbitSamples), v(kOrbitSamples);
+
+        for (double dt : kDts) {
+            for (bool warm : { false, true }) {
+                auto steadyRun = [&](long long *totalIterations) {
+                    for (int i = 0; i < kOrbitSamples; i++) chi[i] = 0.0, r[i] = samples[i].r0, v[i] = samples[i].v0;
+                    for (int k = 1; k <= kSteps; k++) {
+                        for (int i = 0; i < kOrbitSamples; i++) {
+                            dts[i] = k * dt;
+                            guess[i] = warm ? physics::estimateNextChi(chi[i], dt, r[i], v[i], samples[i].sqrt_mu) : NAN;
+                        }
+                        physics::solveUniversalKeplerBatch(params.data(), dts.data(), kOrbitSamples, chi.data(), C.data(), S.data(), iterations.data(),
+                                                           guess.data());
+                        for (int i = 0; i < kOrbitSamples; i++) {
+                            physics::keplerPropagate(chi[i], samples[i], C[i], S[i], dts[i], r[i], &v[i]);
+                            if (totalIterations) *totalIterations += iterations[i];
+                        }
+                    }
+                };
+
+                long long totalIterations = 0;
+                steadyRun(&totalIterations);
+                BenchCounters counters;
+                counters.items = kOrbitSamples * kSteps;
+                counters.avgIterations = static_cast<double>(totalIterations) / counters.items;
+                counters.workingSetBytes = kOrbitSamples * sizeof(physics::KeplerParameters);
+                std::string label = formatParams(regime.name, dt) + (warm ? ";start=warm" : ";start=cold");
+                runner.run("kepler_warm_start", label, [&] { steadyRun(nullptr); }, counters);
+            }
+        }
+    }
+}
+
+// Relative position and velocity error of the batch solver against the scalar one
+void measureBatchError(const std::vector<physics::KeplerParameters> &samples, double dt, const std::vector<double> &chi, const std::vector<double> &C,
+                       const std::vector<double> &S, BenchCounters &counters) {
+    double sumSquared = 0.0, worst = 0.0;
+    for (size_t i = 0; i < samples.size(); i++) {
+        double scalarC, scalarS;
+        double scalarChi = physics::solveUniversalKeplerEquation(samples[i], dt, &scalarC, &scalarS);
+        Eigen::Vector3d r, v, batchR, batchV;
+        physics::keplerPropagate(scalarChi, samples[i], scalarC, scalarS, dt, r, &v);
+        physics::keplerPropagate(chi[i], samples[i], C[i], S[i], dt, batchR, &batchV);
+
+        double error = std::max((batchR - r).norm() / r.norm(), (batchV - v).norm() / v.norm());
+        sumSquared += error * error;
+        worst = std::max(worst, error);
+    }
+    counters.rmsRelativeError = std::sqrt(sumSquared / static_cast<double>(samples.size()));
+    counters.maxRelativeError = worst;
+}
+
+void benchSolveUniversalKeplerBatch(BenchRunner &runner) {
+    if (!runner.enabled("kepler_solve_batch")) return;
+
+    for (const auto &regime : kRegimes) {
+        auto samples = makeOrbitSamples(regime.e);
+        std::vector<const physics::KeplerParameters *> params;
+        for (const auto &p : samples) params.push_back(&p);
+        std::vector<double> chi(kOrbitSamples), C(kOrbitSamples), S(kOrbitSamples);
+        std::vector<int> iterations(kOrbitSamples);
+
+        for (double dt : kDts) {
+            std::vector<double> dts(kOrbitSamples, dt);
+            physics::solveUniversalKeplerBatch(params.data(), dts.data(), kOrbitSamples, chi.data(), C.data(), S.data(), iterations.data());
+
+            BenchCounters counters;
+            counters.items = kOrbitSamples;
+            long long totalIterations = 0;
+            for (int n : iterations) totalIterations += n;
+            counters.avgIterations = static_cast<double>(totalIterations) / kOrbitSamples;
+            counters.workingSetBytes = kOrbitSamples * sizeof(physics::KeplerParameters);
+            measureBatchError(samples, dt, chi, C, S, counters);
+
+            std::string label = formatParams(regime.name, dt) + ";lanes=" + std::to_string(physics::keplerBatchLanes());
+            runner.run("kepler_solve_batch", label, [&] {
+                physics::solveUniversalKeplerBatch(params.data(), dts.data(), kOrbitSamples, chi.data(), C.data(), S.data());
+                doNotOptimize(chi.data());
+            }, counters);
+        }
+    }
+}
+
+void benchSampleTrajectoryPoints(BenchRunner &runner) {
+    constexpr int n = 250;
+    for (const auto &regime : kRegimes) {
+        auto samples = makeOrbitSamples(regime.e);
+        std::vector<Eigen::Vector3d> points;
+        points.reserve(n);
+
+        BenchCounters counters;
+        counters.items = n;
+        counters.workingSetBytes = n * sizeof(Eigen::Vector3d);
+        int i = 0;
+        runner.run("sample_trajectory", std::string("regime=") + regime.name, [&] {
+            points.clear();
+            physics::sampleTrajectoryPoints(samples[i++ % kOrbitSamples], points, n);
+            doNotOptimize(points.data());
+        }, counters);
+    }
+}
+
+void benchRecalculateAllKeplerParameters(BenchRunner &runner) {
+    if (!runner.enabled("recalculate_kepler")) return;
+
+    for (int bodies = 10; bodies <= runner.options().maxBodies; bodies *= 10) {
+        entt::registry registry;
+        createBenchScene(registry, bodies - 10);
+        auto &arrays = physics::gatherBodyArrays(registry);
+
+        BenchCounters counters;
+        counters.items = bodies;
+        counters.workingSetBytes = bodies * (7 * sizeof(double) + sizeof(physics::KeplerParameters));
+        runner.run("recalculate_kepler", formatBodies(bodies) + ";mode=all", [&] {
+            physics::recalculateAllKeplerParameters(arrays);
+        }, counters);
+
+        // Nothing is marked as perturbed after a full recalculation, so this measures
+        // the cost of skipping every body
+        runner.run("recalculate_kepler", formatBodies(bodies) + ";mode=perturbed", [&] {
+            physics::recalculatePerturbedKeplerParameters(arrays);
+        }, counters);
+    }
+}
+
+} // namespace
+
+void runKeplerBenchmarks(BenchRunner &runner) {
+    benchSolveUniversalKeplerEquation(runner);
+    benchSolveUniversalKeplerBatch(runner);
+    benchWarmStart(runner);
+    benchSampleTrajectoryPoints(runner);
+    benchRecalculateAllKeplerParameters(runner);
+}
+
+} // namespace sfs::bench
@@ -0,0 +1,66 @@
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <entt/entt.hpp>
+
+#include "bench/bench.h"
+#include "physics/body_arrays.h"
+#include "physics/kepler.h"
+#include "physics/parallel.h"
+#include "physics/physics.h"
+
+namespace sfs::bench {
+
+namespace {
+
+// 1, 2, 4, ... up to the limit, always including the limit itself
+std::vector<unsigned> threadCounts(const BenchRunner &runner) {
+    unsigned limit = runner.options().maxThreads;
+    if (limit == 0) limit = std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<unsigned> counts;
+    for (unsigned threads = 1; threads < limit; threads *= 2) counts.push_back(threads);
+    counts.push_back(limit);
+    return counts;
+}
+
+// Strong scaling: a fixed scene split across more and more threads. Items/sec divided
+// by the single-thread row gives the speedup.
+void benchScaling(BenchRunner &runner, const char *name, int bodies, const std::function<void(physics::BodyArrays &, physics::ThreadPool *)> &op,
+                  double items) {
+    if (!runner.enabled(name) || bodies > runner.options().maxBodies) return;
+
+    entt::registry registry;
+    createBenchScene(registry, bodies - 10);
+    auto &arrays = physics::gatherBodyArrays(registry);
+
+    BenchCounters counters;
+    counters.items = items;
+    for (unsigned threads : threadCounts(runner)) {
+        physics::ThreadPool pool(threads);
+        std::string params = "bodies=" + std::to_string(bodies) + ";threads=" + std::to_string(threads);
+        runner.run(name, params, [&] { op(arrays, &pool); }, counters);
+    }
+}
+
+} // namespace
+
+void runScalingBenchmarks(BenchRunner &runner) {
+    constexpr int kGravityBodies = 10000;
+    benchScaling(runner, "scaling_gravity", kGravityBodies, [](physics::BodyArrays &arrays, physics::ThreadPool *pool) {
+        physics::gravitySystem(arrays, pool);
+    }, static_cast<double>(kGravityBodies) * (kGravityBodies - 1));
+
+    // NB: Propagation writes back into the arrays, so the scene keeps orbiting between
+    // runs, which is representative of the simulation anyway
+    constexpr int kKeplerBodies = 100000;
+    benchScaling(runner, "scaling_kepler", kKeplerBodies, [](physics::BodyArrays &arrays, physics::ThreadPool *pool) {
+        physics::recalculateAllKeplerParameters(arrays, pool);
+        physics::keplerPropagationSystem(arrays, 3600.0, pool);
+    }, kKeplerBodies);
+}
+
+} // namespace sfs::bench
@@ -0,0 +1,74 @@
+#include "columnar.h"
+
+#include <fstream>
+
+namespace sfs::ensemble {
+
+namespace {
+
+constexpr char kMagic[8] = { 'S', 'F', 'S', 'C', 'O', 'L', 'S', '\0' };
+constexpr uint32_t kVersion = 1;
+
+template<typename T>
+void writeValue(std::ofstream &out, T value) {
+    out.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+void writeString(std::ofstream &out, const std::string &value) {
+    writeValue(out, static_cast<uint32_t>(value.size()));
+    out.write(value.data(), static_cast<std::streamsize>(value.size()));
+}
+
+template<typename T>
+void writeArray(std::ofstream &out, const std::vector<T> &values) {
+    out.write(reinterpret_cast<const char *>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(T)));
+}
+
+} // namespace
+
+void ColumnTable::addColumn(std::string columnName, std::vector<double> values) {
+    columns.push_back(Column{ std::move(columnName), Type::Float64, std::move(values), { } });
+}
+
+void ColumnTable::addColumn(std::string columnName, std::vector<int64_t> values) {
+    columns.push_back(Column{ std::move(columnName), Type::Int64, { }, std::move(values) });
+}
+
+size_t ColumnTable::rows() const {
+    if (columns.empty()) return 0;
+    const auto &first = columns.front();
+    return first.type == Type::Float64 ? first.f64.size() : first.i64.size();
+}
+
+bool writeColumnarFile(const std::string &path, const std::vector<ColumnTable> &tables) {
+    for (const auto &table : tables) {
+        for (const auto &column : table.columns) {
+            size_t size = column.type == ColumnTable::Type::Float64 ? column.f64.size() : column.i64.size();
+            if (size != table.rows()) return false;
+        }
+    }
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+
+    out.write(kMagic, sizeof(kMagic));
+    writeValue(out, kVersion);
+    writeValue(out, static_cast<uint32_t>(tables.size()));
+    for (const auto &table : tables) {
+        writeString(out, table.name);
+        writeValue(out, static_cast<uint64_t>(table.rows()));
+        writeValue(out, static_cast<uint32_t>(table.columns.size()));
+        for (const auto &column : table.columns) {
+            writeString(out, column.name);
+            writeValue(out, static_cast<uint8_t>(column.type));
+            if (column.type == ColumnTable::Type::Float64) {
+                writeArray(out, column.f64);
+            } else {
+                writeArray(out, column.i64);
+            }
+        }
+    }
+    return static_cast<bool>(out);
+}
+
+} // namespace sfs::ensemble
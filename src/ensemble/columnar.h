@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace sfs::ensemble {
+
+// Named table stored column by column, so that each column can be read back as one
+// contiguous array.
+struct ColumnTable {
+    enum class Type : uint8_t {
+        Float64 = 0,
+        Int64 = 1,
+    };
+
+    struct Column {
+        std::string name;
+        Type type;
+        std::vector<double> f64;
+        std::vector<int64_t> i64;
+    };
+
+    std::string name;
+    std::vector<Column> columns;
+
+    void addColumn(std::string columnName, std::vector<double> values);
+    void addColumn(std::string columnName, std::vector<int64_t> values);
+    size_t rows() const;
+};
+
+// Writes the tables into one file, in native byte order:
+//   "SFSCOLS\0", u32 version, u32 table count, then per table
+//   u32 name length, name, u64 row count, u32 column count, then per column
+//   u32 name length, name, u8 type, row count 8-byte values
+//
+// Returns false if the file cannot be written or a table has columns of unequal length.
+bool writeColumnarFile(const std::string &path, const std::vector<ColumnTable> &tables);
+
+} // namespace sfs::ensemble
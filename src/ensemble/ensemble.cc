@@ -0,0 +1,218 @@
+#include "ensemble.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+#include <Eigen/Dense>
+#include <entt/entt.hpp>
+
+#include "ensemble/columnar.h"
+#include "model/solar_system.h"
+#include "physics/body_arrays.h"
+#include "physics/kepler.h"
+#include "physics/parallel.h"
+
+namespace sfs::ensemble {
+
+namespace {
+
+Eigen::Vector3d gaussianVector(std::default_random_engine &generator, std::normal_distribution<double> &normal) {
+    double x = normal(generator);
+    double y = normal(generator);
+    double z = normal(generator);
+    return Eigen::Vector3d(x, y, z);
+}
+
+void perturbScenario(entt::registry &registry, const EnsembleOptions &options, unsigned seed) {
+    std::default_random_engine generator(seed);
+    std::normal_distribution<double> normal(0.0, 1.0);
+    // NB: Visit bodies in entity order so that the draws do not depend on pool layout
+    std::vector<entt::entity> entities;
+    for (auto entity : registry.view<physics::BodyState, physics::Body>()) entities.push_back(entity);
+    std::sort(entities.begin(), entities.end());
+
+    for (auto entity : entities) {
+        auto &body = registry.get<physics::Body>(entity);
+        auto &state = registry.get<physics::BodyState>(entity);
+        body.mass *= std::max(1.0 + options.massSigma * normal(generator), 1e-6);
+        if (state.st.primary == entt::null) continue;
+        state.st.pos += options.positionSigma * state.st.pos.norm() * gaussianVector(generator, normal);
+        state.st.vel += options.velocitySigma * state.st.vel.norm() * gaussianVector(generator, normal);
+    }
+    physics::recalculateAllKeplerParameters(registry);
+}
+
+bool isAncestor(const physics::BodyArrays &bodies, size_t ancestor, size_t i) {
+    for (int32_t cur = bodies.primary[i]; cur >= 0; cur = bodies.primary[cur]) {
+        if (static_cast<size_t>(cur) == ancestor) return true;
+    }
+    return false;
+}
+
+// Pairs of (body, massive body) whose distance is tracked, and whether each pair is
+// currently within the approach distance. Bodies are kept as rows in the order of the
+// first layout, since switching primaries rebuilds the layout in a different order.
+struct ApproachTracker {
+    std::vector<entt::entity> entity;  // Of every row
+    std::vector<uint32_t> index;       // Current index of every row in the body arrays
+    std::vector<uint32_t> massive;     // Rows
+    std::vector<uint8_t> inside;       // row * massive.size() + k
+};
+
+void updateIndices(const physics::BodyArrays &bodies, ApproachTracker &tracker) {
+    for (size_t row = 0; row < tracker.entity.size(); row++) {
+        tracker.index[row] = static_cast<uint32_t>(bodies.indexOf[entt::to_entity(tracker.entity[row])]);
+    }
+}
+
+void trackApproaches(const physics::BodyArrays &bodies, const EnsembleOptions &options, double time, ApproachTracker &tracker,
+                     MemberResult &result) {
+    updateIndices(bodies, tracker);
+    size_t m = tracker.massive.size();
+    for (size_t row = 0; row < tracker.entity.size(); row++) {
+        size_t i = tracker.index[row];
+        for (size_t k = 0; k < m; k++) {
+            size_t j = tracker.index[tracker.massive[k]];
+            if (j == i || isAncestor(bodies, j, i) || isAncestor(bodies, i, j)) continue;
+
+            double rx = bodies.ax[j] - bodies.ax[i], ry = bodies.ay[j] - bodies.ay[i], rz = bodies.az[j] - bodies.az[i];
+            double distance = std::sqrt(rx * rx + ry * ry + rz * rz);
+            if (distance < result.minApproach[row]) {
+                result.minApproach[row] = distance;
+                result.minApproachTime[row] = time;
+                result.minApproachBody[row] = static_cast<int64_t>(entt::to_integral(bodies.entity[j]));
+            }
+
+            bool inside = distance < options.approachDistance;
+            if (inside && !tracker.inside[row * m + k]) result.approachEvents++;
+            tracker.inside[row * m + k] = inside;
+        }
+    }
+}
+
+MemberResult runMember(const EnsembleOptions &options, int member) {
+    auto start = std::chrono::steady_clock::now();
+    MemberResult result;
+    result.seed = options.seed + static_cast<unsigned>(member);
+
+    entt::registry registry;
+    auto sun = model::createSolarSystem(registry);
+    if (options.asteroids > 0) model::createAsteroidBelt(registry, sun, options.asteroids, options.seed);
+    if (member != 0) perturbScenario(registry, options, result.seed);
+
+    auto settings = options.physics;
+    settings.threadCount = 1;
+    registry.ctx().insert_or_assign(settings);
+
+    Eigen::Vector3d com, momentum, angularMomentum;
+    physics::calculateConservedQuantities(registry, com, result.initialEnergy, momentum, angularMomentum);
+
+    // Results are kept per row of the tracker. No body is created or destroyed during the
+    // run, but primary switches reorder the layout.
+    const auto &bodies = physics::getBodyArrays(registry);
+    size_t n = bodies.size();
+    result.minApproach.assign(n, INFINITY);
+    result.minApproachTime.assign(n, 0.0);
+    result.minApproachBody.assign(n, -1);
+
+    ApproachTracker tracker;
+    tracker.entity = bodies.entity;
+    tracker.index.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        if (bodies.m[i] >= options.massiveBodyMass) tracker.massive.push_back(static_cast<uint32_t>(i));
+    }
+    tracker.inside.assign(n * tracker.massive.size(), 0);
+    trackApproaches(bodies, options, 0.0, tracker, result);
+
+    for (long long step = 0; step < options.steps; step++) {
+        physics::physicsUpdate(registry, options.dt);
+        if ((step + 1) % options.approachInterval == 0) {
+            trackApproaches(physics::getBodyArrays(registry), options, static_cast<double>(step + 1) * options.dt, tracker, result);
+        }
+    }
+
+    physics::calculateConservedQuantities(registry, com, result.finalEnergy, momentum, angularMomentum);
+
+    const auto &final = physics::getBodyArrays(registry);
+    updateIndices(final, tracker);
+    for (size_t row = 0; row < n; row++) {
+        size_t i = tracker.index[row];
+        result.entity.push_back(static_cast<int64_t>(entt::to_integral(final.entity[i])));
+        result.mass.push_back(final.m[i]);
+        result.x.push_back(final.ax[i]), result.y.push_back(final.ay[i]), result.z.push_back(final.az[i]);
+        result.vx.push_back(final.avx[i]), result.vy.push_back(final.avy[i]), result.vz.push_back(final.avz[i]);
+    }
+
+    result.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+} // namespace
+
+std::vector<MemberResult> runEnsemble(const EnsembleOptions &options) {
+    std::vector<MemberResult> results(options.members);
+    physics::ThreadPool pool(options.threads);
+    // One member per chunk, so that work stealing balances uneven members
+    physics::parallelFor(&pool, 0, results.size(), 1, [&](size_t first, size_t last) {
+        for (size_t member = first; member < last; member++) results[member] = runMember(options, static_cast<int>(member));
+    });
+    return results;
+}
+
+bool writeEnsembleResults(const std::string &path, const std::vector<MemberResult> &results) {
+    ColumnTable members{ "members", { } };
+    std::vector<int64_t> memberIndex, seed, approachEvents;
+    std::vector<double> wallSeconds, initialEnergy, finalEnergy, relativeEnergyDrift;
+    for (size_t k = 0; k < results.size(); k++) {
+        const auto &result = results[k];
+        memberIndex.push_back(static_cast<int64_t>(k));
+        seed.push_back(result.seed);
+        approachEvents.push_back(result.approachEvents);
+        wallSeconds.push_back(result.wallSeconds);
+        initialEnergy.push_back(result.initialEnergy);
+        finalEnergy.push_back(result.finalEnergy);
+        relativeEnergyDrift.push_back((result.finalEnergy - result.initialEnergy) / std::fabs(result.initialEnergy));
+    }
+    members.addColumn("member", std::move(memberIndex));
+    members.addColumn("seed", std::move(seed));
+    members.addColumn("wall_seconds", std::move(wallSeconds));
+    members.addColumn("initial_energy", std::move(initialEnergy));
+    members.addColumn("final_energy", std::move(finalEnergy));
+    members.addColumn("relative_energy_drift", std::move(relativeEnergyDrift));
+    members.addColumn("approach_events", std::move(approachEvents));
+
+    ColumnTable bodies{ "bodies", { } };
+    std::vector<int64_t> member;
+    std::vector<int64_t> entity, minApproachBody;
+    std::vector<double> mass, x, y, z, vx, vy, vz, minApproach, minApproachTime;
+    auto append = [](auto &to, const auto &from) { to.insert(to.end(), from.begin(), from.end()); };
+    for (size_t k = 0; k < results.size(); k++) {
+        const auto &result = results[k];
+        member.insert(member.end(), result.entity.size(), static_cast<int64_t>(k));
+        append(entity, result.entity);
+        append(mass, result.mass);
+        append(x, result.x), append(y, result.y), append(z, result.z);
+        append(vx, result.vx), append(vy, result.vy), append(vz, result.vz);
+        append(minApproach, result.minApproach);
+        append(minApproachTime, result.minApproachTime);
+        append(minApproachBody, result.minApproachBody);
+    }
+    bodies.addColumn("member", std::move(member));
+    bodies.addColumn("entity", std::move(entity));
+    bodies.addColumn("mass", std::move(mass));
+    bodies.addColumn("x", std::move(x));
+    bodies.addColumn("y", std::move(y));
+    bodies.addColumn("z", std::move(z));
+    bodies.addColumn("vx", std::move(vx));
+    bodies.addColumn("vy", std::move(vy));
+    bodies.addColumn("vz", std::move(vz));
+    bodies.addColumn("min_approach", std::move(minApproach));
+    bodies.addColumn("min_approach_time", std::move(minApproachTime));
+    bodies.addColumn("min_approach_entity", std::move(minApproachBody));
+
+    return writeColumnarFile(path, { members, bodies });
+}
+
+} // namespace sfs::ensemble
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "physics/physics.h"
+
+namespace sfs::ensemble {
+
+struct EnsembleOptions {
+    int members = 16;
+    unsigned threads = 0;  // Members stepped concurrently, 0 for one per hardware thread
+    unsigned seed = 1;     // Seeds the asteroid belt, shared by all members, and member k's perturbations with seed + k
+    long long steps = 10000;
+    double dt = 36000.0;
+    int asteroids = 0;
+
+    // Relative 1-sigma perturbations of every member but member 0, which is the nominal
+    // scenario. Positions and velocities are relative to the primary.
+    double massSigma = 0.0;
+    double positionSigma = 0.0;
+    double velocitySigma = 0.0;
+
+    // Every body is checked against the bodies at least `massiveBodyMass` heavy every
+    // `approachInterval` steps, skipping its own ancestors and satellites
+    double massiveBodyMass = 1.0e22;
+    double approachDistance = 1.0e9;  // An approach event is counted each time a pair comes closer than this
+    int approachInterval = 10;
+
+    // Settings for each member. The thread count is ignored, since members already run
+    // one per worker.
+    physics::PhysicsSettings physics;
+};
+
+struct MemberResult {
+    unsigned seed = 0;
+    double wallSeconds = 0.0;
+    double initialEnergy = 0.0;
+    double finalEnergy = 0.0;
+    long long approachEvents = 0;
+
+    // Per body, in the physics ordering at the start of the run. States are absolute.
+    std::vector<int64_t> entity;
+    std::vector<double> mass;
+    std::vector<double> x, y, z;
+    std::vector<double> vx, vy, vz;
+    std::vector<double> minApproach;      // Closest checked distance to a massive body, infinite if none was checked
+    std::vector<double> minApproachTime;  // Simulated time of that distance
+    std::vector<int64_t> minApproachBody; // Entity of that massive body, -1 if none
+};
+
+// Builds every member from createSolarSystem (and createAsteroidBelt), perturbs it and
+// steps it in its own registry. Members are dealt to a thread pool one at a time, so
+// each worker owns the one registry it is stepping. Results are identical for any
+// thread count.
+std::vector<MemberResult> runEnsemble(const EnsembleOptions &options);
+
+// Writes a "members" table with one row per member and a "bodies" table with one row
+// per body of every member, as described by writeColumnarFile
+bool writeEnsembleResults(const std::string &path, const std::vector<MemberResult> &results);
+
+} // namespace sfs::ensemble
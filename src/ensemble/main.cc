@@ -0,0 +1,94 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "ensemble/ensemble.h"
+
+namespace {
+
+struct CommandLine {
+    sfs::ensemble::EnsembleOptions ensemble;
+    std::string output = "ensemble.sfscols";
+};
+
+void printUsage(const char *program) {
+    std::cerr << "Usage: " << program << " [--members K] [--threads N] [--seed S] [--steps N] [--dt SECONDS] [--asteroids N]"
+              << " [--mass-sigma S] [--position-sigma S] [--velocity-sigma S] [--approach-distance METERS] [--approach-every STEPS]"
+              << " [--output PATH]" << std::endl;
+}
+
+bool parseOptions(int argc, char **argv, CommandLine &commandLine) {
+    auto &options = commandLine.ensemble;
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!value) return false;
+        if (std::strcmp(arg, "--members") == 0) {
+            options.members = std::atoi(value);
+        } else if (std::strcmp(arg, "--threads") == 0) {
+            options.threads = static_cast<unsigned>(std::strtoul(value, nullptr, 10));
+        } else if (std::strcmp(arg, "--seed") == 0) {
+            options.seed = static_cast<unsigned>(std::strtoul(value, nullptr, 10));
+        } else if (std::strcmp(arg, "--steps") == 0) {
+            options.steps = std::strtoll(value, nullptr, 10);
+        } else if (std::strcmp(arg, "--dt") == 0) {
+            options.dt = std::strtod(value, nullptr);
+        } else if (std::strcmp(arg, "--asteroids") == 0) {
+            options.asteroids = std::atoi(value);
+        } else if (std::strcmp(arg, "--mass-sigma") == 0) {
+            options.massSigma = std::strtod(value, nullptr);
+        } else if (std::strcmp(arg, "--position-sigma") == 0) {
+            options.positionSigma = std::strtod(value, nullptr);
+        } else if (std::strcmp(arg, "--velocity-sigma") == 0) {
+            options.velocitySigma = std::strtod(value, nullptr);
+        } else if (std::strcmp(arg, "--approach-distance") == 0) {
+            options.approachDistance = std::strtod(value, nullptr);
+        } else if (std::strcmp(arg, "--approach-every") == 0) {
+            options.approachInterval = std::atoi(value);
+        } else if (std::strcmp(arg, "--output") == 0) {
+            commandLine.output = value;
+        } else {
+            return false;
+        }
+        i++;
+    }
+    return options.members > 0 && options.steps > 0 && options.dt != 0.0 && options.approachInterval > 0;
+}
+
+} // namespace
+
+// Steps perturbed copies of the solar system concurrently and writes per-member
+// summaries to one columnar file
+int main(int argc, char **argv) {
+    CommandLine commandLine;
+    if (!parseOptions(argc, argv, commandLine)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto results = sfs::ensemble::runEnsemble(commandLine.ensemble);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (!sfs::ensemble::writeEnsembleResults(commandLine.output, results)) {
+        std::cerr << "Failed to write " << commandLine.output << std::endl;
+        return 1;
+    }
+
+    double memberSeconds = 0.0, maxDrift = 0.0;
+    long long approachEvents = 0;
+    for (const auto &result : results) {
+        memberSeconds += result.wallSeconds;
+        maxDrift = std::max(maxDrift, std::fabs((result.finalEnergy - result.initialEnergy) / result.initialEnergy));
+        approachEvents += result.approachEvents;
+    }
+    std::cout << "Members: " << results.size() << std::endl;
+    std::cout << "Wall time: " << seconds << " s (concurrency " << memberSeconds / seconds << ")" << std::endl;
+    std::cout << "Max relative energy drift: " << maxDrift << std::endl;
+    std::cout << "Approach events: " << approachEvents << std::endl;
+    std::cout << "Wrote " << commandLine.output << std::endl;
+    return 0;
+}
@@ -0,0 +1,226 @@
+#include "chebyshev.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "physics/body_arrays.h"
+
+namespace sfs::ephemeris {
+
+namespace {
+
+constexpr size_t kComponents = 6;
+
+// T_k(x) and dT_k/dx for k < count
+void chebyshevBasis(double x, size_t count, double *T, double *dT) {
+    T[0] = 1, dT[0] = 0;
+    if (count > 1) T[1] = x, dT[1] = 1;
+    for (size_t k = 2; k < count; k++) {
+        T[k] = 2 * x * T[k - 1] - T[k - 2];
+        dT[k] = 2 * T[k - 1] + 2 * x * dT[k - 1] - dT[k - 2];
+    }
+}
+
+} // namespace
+
+ChebyshevEphemeris::ChebyshevEphemeris(double window, int degree) : window_(window), coefficientCount_(std::max(degree, 1) + 1) { }
+
+void ChebyshevEphemeris::step(entt::registry &registry, double time) {
+    const auto &bodies = physics::getBodyArrays(registry);
+    if (!started_) {
+        started_ = true;
+        origin_ = time;
+    }
+    if (!matchColumns(bodies)) updateColumns(bodies, time);
+
+    times_.push_back(time);
+    size_t offset = states_.size();
+    states_.resize(offset + bodies.size() * kComponents);
+    double *out = states_.data() + offset;
+    for (size_t column = 0; column < entities_.size(); column++, out += kComponents) {
+        size_t i = columnIndex_[column];
+        out[0] = bodies.ax[i], out[1] = bodies.ay[i], out[2] = bodies.az[i];
+        out[3] = bodies.avx[i], out[4] = bodies.avy[i], out[5] = bodies.avz[i];
+    }
+    statistics_.bodySamples += bodies.size();
+
+    // A long step can close several windows, which are then fitted to the same samples
+    while (time >= origin_ + static_cast<double>(fittedWindows_ + 1) * window_) {
+        fitWindow(fittedWindows_);
+        dropSamples(fittedWindows_);
+        fittedWindows_++;
+    }
+}
+
+bool ChebyshevEphemeris::matchColumns(const physics::BodyArrays &bodies) {
+    if (entities_.size() != bodies.size()) return false;
+    columnIndex_.resize(entities_.size());
+    for (size_t column = 0; column < entities_.size(); column++) {
+        auto id = entt::to_entity(entities_[column]);
+        int32_t i = id < bodies.indexOf.size() ? bodies.indexOf[id] : -1;
+        if (i < 0 || bodies.entity[i] != entities_[column]) return false;
+        columnIndex_[column] = static_cast<uint32_t>(i);
+    }
+    return true;
+}
+
+void ChebyshevEphemeris::updateColumns(const physics::BodyArrays &bodies, double time) {
+    // Surviving bodies keep their samples, in their old column order, and new bodies are
+    // appended. The samples of bodies that disappeared are dropped.
+    std::vector<entt::entity> entities;
+    std::vector<double> since;
+    std::vector<int64_t> from;  // Old column, or -1 for new bodies
+    std::vector<uint8_t> kept(bodies.size(), 0);
+    for (size_t column = 0; column < entities_.size(); column++) {
+        auto id = entt::to_entity(entities_[column]);
+        int32_t i = id < bodies.indexOf.size() ? bodies.indexOf[id] : -1;
+        if (i < 0 || bodies.entity[i] != entities_[column]) continue;
+        kept[i] = 1;
+        entities.push_back(entities_[column]);
+        since.push_back(since_[column]);
+        from.push_back(static_cast<int64_t>(column));
+    }
+    for (size_t i = 0; i < bodies.size(); i++) {
+        if (kept[i]) continue;
+        entities.push_back(bodies.entity[i]);
+        since.push_back(time);
+        from.push_back(-1);
+    }
+
+    // New bodies have no earlier samples; NaN marks them, though they are never fitted
+    size_t oldStride = entities_.size() * kComponents, stride = entities.size() * kComponents;
+    std::vector<double> states(times_.size() * stride, std::numeric_limits<double>::quiet_NaN());
+    for (size_t s = 0; s < times_.size(); s++) {
+        for (size_t column = 0; column < entities.size(); column++) {
+            if (from[column] < 0) continue;
+            const double *in = states_.data() + s * oldStride + static_cast<size_t>(from[column]) * kComponents;
+            std::copy(in, in + kComponents, states.data() + s * stride + column * kComponents);
+        }
+    }
+
+    entities_ = std::move(entities);
+    since_ = std::move(since);
+    states_ = std::move(states);
+    matchColumns(bodies);
+}
+
+void ChebyshevEphemeris::fitWindow(size_t window) {
+    double start = origin_ + static_cast<double>(window) * window_;
+    if (times_.empty() || times_.front() > start) return;
+
+    // Samples before the last one at or before `start` add nothing but conditioning trouble
+    size_t first = 0;
+    while (first + 1 < times_.size() && times_[first + 1] <= start) first++;
+    size_t samples = times_.size() - first;
+    // Bodies that appeared after the first sample cannot be fitted in this window
+    std::vector<size_t> columns;
+    for (size_t column = 0; column < entities_.size(); column++) {
+        if (since_[column] <= times_[first]) columns.push_back(column);
+    }
+    size_t bodies = columns.size();
+    if (bodies == 0) return;
+    size_t stride = entities_.size() * kComponents;
+    // Leaves spare rows where there are enough samples, so that the residuals say
+    // something about the fit. Sparse windows fall back to Hermite interpolation.
+    size_t count = std::min(coefficientCount_, 2 * samples > 8 ? 2 * samples - 4 : 2 * samples);
+
+    // Rows are positions, then velocities in units of half a window, so that both are
+    // in metres: dp/dx = v window / 2
+    Eigen::MatrixXd A(2 * samples, count);
+    Eigen::MatrixXd B(2 * samples, 3 * bodies);
+    std::vector<double> T(count), dT(count);
+    for (size_t s = 0; s < samples; s++) {
+        double x = 2 * (times_[first + s] - start) / window_ - 1;
+        chebyshevBasis(x, count, T.data(), dT.data());
+        for (size_t k = 0; k < count; k++) {
+            A(s, k) = T[k];
+            A(samples + s, k) = dT[k];
+        }
+        for (size_t i = 0; i < bodies; i++) {
+            const double *state = states_.data() + (first + s) * stride + columns[i] * kComponents;
+            for (int c = 0; c < 3; c++) {
+                B(s, 3 * i + c) = state[c];
+                B(samples + s, 3 * i + c) = state[3 + c] * window_ / 2;
+            }
+        }
+    }
+    // All bodies share the sample times, so one factorization solves every coordinate
+    auto qr = A.colPivHouseholderQr();
+    Eigen::MatrixXd C = qr.solve(B);
+    Eigen::MatrixXd residual = A.topRows(samples) * C - B.topRows(samples);
+
+    size_t segmentStride = 3 * coefficientCount_;
+    for (size_t i = 0; i < bodies; i++) {
+        double errorBound = 0;
+        for (size_t s = 0; s < samples; s++) errorBound = std::max(errorBound, residual.block<1, 3>(s, 3 * i).norm());
+        errorBound += C.block<1, 3>(count - 2, 3 * i).norm() + C.block<1, 3>(count - 1, 3 * i).norm();
+
+        auto [it, inserted] = tracks_.try_emplace(entities_[columns[i]]);
+        auto &track = it->second;
+        if (inserted) track.firstWindow = window;
+        // Pads windows the body was not cached in
+        size_t segment = window - track.firstWindow;
+        track.coefficients.resize(segment * segmentStride, 0.0);
+        track.errorBounds.resize(segment, std::numeric_limits<double>::quiet_NaN());
+
+        track.coefficients.resize((segment + 1) * segmentStride, 0.0);
+        double *out = track.coefficients.data() + segment * segmentStride;
+        for (int c = 0; c < 3; c++) {
+            for (size_t k = 0; k < count; k++) out[c * coefficientCount_ + k] = C(k, 3 * i + c);
+        }
+        track.errorBounds.push_back(errorBound);
+
+        statistics_.maxErrorBound = std::max(statistics_.maxErrorBound, errorBound);
+        statistics_.segments++;
+        statistics_.bytes += segmentStride * sizeof(double) + sizeof(double);
+    }
+    statistics_.windows++;
+}
+
+void ChebyshevEphemeris::dropSamples(size_t window) {
+    // Keeps the last sample at or before the next window's start, which brackets it
+    double next = origin_ + static_cast<double>(window + 1) * window_;
+    size_t first = 0;
+    while (first + 1 < times_.size() && times_[first + 1] <= next) first++;
+    if (first == 0) return;
+    size_t stride = entities_.size() * kComponents;
+    times_.erase(times_.begin(), times_.begin() + static_cast<ptrdiff_t>(first));
+    states_.erase(states_.begin(), states_.begin() + static_cast<ptrdiff_t>(first * stride));
+}
+
+bool ChebyshevEphemeris::evaluate(entt::entity entity, double time, State &state) const {
+    if (!(time >= begin() && time <= end())) return false;
+    auto it = tracks_.find(entity);
+    if (it == tracks_.end()) return false;
+    const auto &track = it->second;
+
+    // The end of the history belongs to the last window
+    size_t window = std::min(static_cast<size_t>((time - origin_) / window_), fittedWindows_ - 1);
+    if (window < track.firstWindow || window - track.firstWindow >= track.errorBounds.size()) return false;
+    size_t segment = window - track.firstWindow;
+    if (std::isnan(track.errorBounds[segment])) return false;
+
+    double start = origin_ + static_cast<double>(window) * window_;
+    double x = 2 * (time - start) / window_ - 1;
+    const double *coefficients = track.coefficients.data() + segment * 3 * coefficientCount_;
+    for (int c = 0; c < 3; c++) {
+        // Same recurrence as chebyshevBasis, summed on the fly
+        const double *a = coefficients + c * coefficientCount_;
+        double T0 = 1, T1 = x, dT0 = 0, dT1 = 1;
+        double p = a[0] + a[1] * x, dp = a[1];
+        for (size_t k = 2; k < coefficientCount_; k++) {
+            double T2 = 2 * x * T1 - T0;
+            double dT2 = 2 * T1 + 2 * x * dT1 - dT0;
+            p += a[k] * T2;
+            dp += a[k] * dT2;
+            T0 = T1, T1 = T2, dT0 = dT1, dT1 = dT2;
+        }
+        state.position[c] = p;
+        state.velocity[c] = dp * 2 / window_;
+    }
+    state.errorBound = track.errorBounds[segment];
+    return true;
+}
+
+} // namespace sfs::ephemeris
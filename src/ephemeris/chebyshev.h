@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <entt/entt.hpp>
+
+namespace sfs::physics {
+
+struct BodyArrays;
+
+} // namespace sfs::physics
+
+namespace sfs::ephemeris {
+
+// Cache of absolute body trajectories as Chebyshev segments, in the style of JPL SPK
+// type 2 and 3 records, so that states at past times can be queried without keeping raw
+// samples or integrating again.
+//
+// Time is split into fixed windows of `window` seconds, starting at the first sampled
+// step. Once a step passes the end of a window, each body's samples in it are fitted
+// by least squares to positions and velocities at once, giving `degree` + 1 coefficients
+// per coordinate. A window is only fitted if samples bracket it on both sides, so it
+// should span a few steps at least.
+//
+// Each segment keeps an error bound: the largest position residual at the samples plus
+// the size of the last two coefficients, which estimates the truncation error between
+// them. Windows of fewer than five samples are interpolated exactly, leaving only the
+// truncation estimate, which can then be exceeded.
+//
+// Samples are matched to bodies by entity, so reordering the body arrays, as switching
+// primaries does, changes nothing. A body that appears partway through a window is only
+// cached from the next one, and one that disappears loses its open window.
+//
+// NB: Assumes time moves forward
+class ChebyshevEphemeris {
+public:
+    struct State {
+        Eigen::Vector3d position;
+        Eigen::Vector3d velocity;
+        double errorBound;  // Position error bound of the segment, m
+    };
+
+    struct Statistics {
+        size_t windows = 0;        // Fitted windows
+        size_t segments = 0;       // Body segments over all windows
+        size_t bodySamples = 0;    // Body states taken, for comparison with raw storage
+        double maxErrorBound = 0;  // Largest error bound of any segment, m
+        size_t bytes = 0;          // Coefficients and error bounds
+    };
+
+    ChebyshevEphemeris(double window, int degree = 12);
+
+    // Call after every physics step
+    void step(entt::registry &registry, double time);
+
+    // State of `entity` at `time`, or false if that time is outside the fitted windows
+    // of the body. O(degree), whatever the length of the history.
+    bool evaluate(entt::entity entity, double time, State &state) const;
+
+    // Start and end of the fitted history, equal if nothing is fitted yet
+    double begin() const { return origin_; }
+    double end() const { return origin_ + static_cast<double>(fittedWindows_) * window_; }
+
+    const Statistics &statistics() const { return statistics_; }
+
+private:
+    struct Track {
+        size_t firstWindow;
+        std::vector<double> coefficients;  // [segment][x, y, z][degree + 1]
+        std::vector<double> errorBounds;   // [segment], NaN where the window was not cached
+    };
+
+    // Points columnIndex_ at the bodies of each column. Returns false if the body set no
+    // longer matches the columns.
+    bool matchColumns(const physics::BodyArrays &bodies);
+    // Drops the columns of bodies that are gone and adds ones for new bodies at `time`
+    void updateColumns(const physics::BodyArrays &bodies, double time);
+    void fitWindow(size_t window);
+    // Drops samples no longer needed once `window` is done
+    void dropSamples(size_t window);
+
+    double window_;
+    size_t coefficientCount_;
+
+    bool started_ = false;
+    double origin_ = 0;
+    size_t fittedWindows_ = 0;  // Also the index of the open window
+
+    // Samples of the open window, in one column per body
+    std::vector<entt::entity> entities_;  // [column]
+    std::vector<double> since_;           // [column], time of the body's first sample
+    std::vector<uint32_t> columnIndex_;   // [column], index of the body in the body arrays
+    std::vector<double> times_;
+    std::vector<double> states_;  // [sample][column][x, y, z, vx, vy, vz]
+
+    std::unordered_map<entt::entity, Track> tracks_;
+    Statistics statistics_;
+};
+
+} // namespace sfs::ephemeris
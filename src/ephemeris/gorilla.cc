@@ -0,0 +1,115 @@
+#include "gorilla.h"
+
+#include <cstring>
+
+namespace sfs::ephemeris {
+
+namespace {
+
+uint64_t toBits(double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+double fromBits(uint64_t bits) {
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+double predict(const double *values, size_t n, size_t stride) {
+    if (n == 1) return values[0];
+    return 2.0 * values[(n - 1) * stride] - values[(n - 2) * stride];
+}
+
+} // namespace
+
+void BitWriter::write(uint64_t bits, int count) {
+    // NB: Split wide writes so that the pending word never overflows
+    if (count > 32) {
+        write(bits >> 32, count - 32);
+        count = 32;
+    }
+    uint64_t mask = count == 64 ? ~uint64_t{ 0 } : (uint64_t{ 1 } << count) - 1;
+    pending_ = (pending_ << count) | (bits & mask);
+    pendingBits_ += count;
+    while (pendingBits_ >= 8) {
+        pendingBits_ -= 8;
+        bytes_.push_back(static_cast<uint8_t>(pending_ >> pendingBits_));
+    }
+}
+
+const std::vector<uint8_t> &BitWriter::finish() {
+    if (pendingBits_ > 0) write(0, 8 - pendingBits_);
+    return bytes_;
+}
+
+void BitWriter::clear() {
+    bytes_.clear();
+    pending_ = 0;
+    pendingBits_ = 0;
+}
+
+uint64_t BitReader::read(int count) {
+    uint64_t bits = 0;
+    for (int i = 0; i < count; i++, position_++) {
+        size_t byte = position_ / 8;
+        uint64_t bit = byte < size_ ? (data_[byte] >> (7 - position_ % 8)) & 1 : 0;
+        bits = (bits << 1) | bit;
+    }
+    return bits;
+}
+
+void encodeSeries(BitWriter &out, const double *values, size_t count, size_t stride) {
+    if (count == 0) return;
+    out.write(toBits(values[0]), 64);
+
+    int leading = -1, length = 0;  // Window of the previous meaningful bits, none yet
+    for (size_t n = 1; n < count; n++) {
+        uint64_t x = toBits(values[n * stride]) ^ toBits(predict(values, n, stride));
+        if (x == 0) {
+            out.write(0, 1);
+            continue;
+        }
+
+        int lz = __builtin_clzll(x);
+        int tz = __builtin_ctzll(x);
+        if (leading >= 0 && lz >= leading && tz >= 64 - leading - length) {
+            out.write(0b10, 2);
+            out.write(x >> (64 - leading - length), length);
+        } else {
+            leading = lz > 63 ? 63 : lz;
+            length = 64 - leading - tz;
+            out.write(0b11, 2);
+            out.write(static_cast<uint64_t>(leading), 6);
+            out.write(static_cast<uint64_t>(length - 1), 6);
+            out.write(x >> tz, length);
+        }
+    }
+}
+
+bool decodeSeries(BitReader &in, double *values, size_t count, size_t stride) {
+    if (count == 0) return true;
+    values[0] = fromBits(in.read(64));
+
+    int leading = 0, length = 0;
+    for (size_t n = 1; n < count; n++) {
+        uint64_t x = 0;
+        if (in.read(1)) {
+            if (in.read(1)) {
+                leading = static_cast<int>(in.read(6));
+                length = static_cast<int>(in.read(6)) + 1;
+                if (leading + length > 64) return false;
+            } else if (length == 0) {
+                // Reuses the previous window, of which there is none yet
+                return false;
+            }
+            x = in.read(length) << (64 - leading - length);
+        }
+        values[n * stride] = fromBits(toBits(predict(values, n, stride)) ^ x);
+    }
+    return !in.exhausted();
+}
+
+} // namespace sfs::ephemeris
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace sfs::ephemeris {
+
+// Gorilla-style XOR compression of double time series (Pelkonen et al., 2015), with the
+// linear prediction 2 x[n-1] - x[n-2] in place of the previous value, since body
+// states move smoothly between samples.
+//
+// Each value is XORed with its prediction and stored as:
+//   '0'                    the XOR is zero
+//   '10' + bits            the meaningful bits fit the previous value's window
+//   '11' + 6 bits leading zeros + 6 bits length - 1 + bits
+// The first value of a series is stored as its 64 raw bits.
+
+class BitWriter {
+public:
+    void write(uint64_t bits, int count);
+    // Pads to a whole byte and returns the bytes written so far
+    const std::vector<uint8_t> &finish();
+    void clear();
+
+private:
+    std::vector<uint8_t> bytes_;
+    uint64_t pending_ = 0;
+    int pendingBits_ = 0;
+};
+
+class BitReader {
+public:
+    BitReader(const uint8_t *data, size_t size) : data_(data), size_(size) { }
+    // Returns zeros past the end, which `exhausted` then reports
+    uint64_t read(int count);
+    bool exhausted() const { return position_ > size_ * 8; }
+
+private:
+    const uint8_t *data_;
+    size_t size_;
+    size_t position_ = 0;  // In bits
+};
+
+// Appends `count` values read `stride` doubles apart
+void encodeSeries(BitWriter &out, const double *values, size_t count, size_t stride);
+// Reads `count` values back, `stride` doubles apart. Returns false on truncated input.
+bool decodeSeries(BitReader &in, double *values, size_t count, size_t stride);
+
+} // namespace sfs::ephemeris
@@ -0,0 +1,199 @@
+#include "recorder.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "ephemeris/gorilla.h"
+#include "physics/body_arrays.h"
+
+namespace sfs::ephemeris {
+
+namespace {
+
+constexpr char kMagic[8] = { 'S', 'F', 'S', 'E', 'P', 'H', 'M', '\0' };
+constexpr uint32_t kVersion = 1;
+constexpr size_t kComponents = 6;
+
+struct ChunkHeader {
+    uint32_t frames;
+    uint32_t bodies;
+    uint64_t payloadSize;
+};
+
+bool sameBodies(const EphemerisChunk &chunk, const physics::BodyArrays &bodies) {
+    if (chunk.bodies() != bodies.size()) return false;
+    for (size_t i = 0; i < bodies.size(); i++) {
+        if (chunk.entities[i] != entt::to_integral(bodies.entity[i])) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+void EphemerisChunk::clear() {
+    times.clear();
+    entities.clear();
+    states.clear();
+}
+
+EphemerisRecorder::EphemerisRecorder(const std::string &path, unsigned interval, size_t framesPerChunk)
+    : interval_(std::max(interval, 1u)), framesPerChunk_(std::max<size_t>(framesPerChunk, 1)) {
+    file_ = std::fopen(path.c_str(), "wb");
+    if (!file_) return;
+    opened_ = true;
+    if (std::fwrite(kMagic, sizeof(kMagic), 1, file_) != 1 || std::fwrite(&kVersion, sizeof(kVersion), 1, file_) != 1) failed_ = true;
+    writer_ = std::thread(&EphemerisRecorder::writerLoop, this);
+}
+
+void EphemerisRecorder::finish() {
+    if (!file_) return;
+    handOff(true);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_one();
+    writer_.join();
+    if (std::fclose(file_) != 0) failed_ = true;
+    file_ = nullptr;
+}
+
+void EphemerisRecorder::step(entt::registry &registry, double time) {
+    if (!file_ || steps_++ % interval_ != 0) return;
+
+    const auto &bodies = physics::getBodyArrays(registry);
+    if (!sameBodies(buffers_[filling_], bodies)) {
+        handOff();
+        auto &chunk = buffers_[filling_];
+        chunk.entities.resize(bodies.size());
+        for (size_t i = 0; i < bodies.size(); i++) chunk.entities[i] = entt::to_integral(bodies.entity[i]);
+    }
+
+    auto &chunk = buffers_[filling_];
+    chunk.times.push_back(time);
+    size_t offset = chunk.states.size();
+    chunk.states.resize(offset + bodies.size() * kComponents);
+    double *out = chunk.states.data() + offset;
+    for (size_t i = 0; i < bodies.size(); i++, out += kComponents) {
+        out[0] = bodies.ax[i], out[1] = bodies.ay[i], out[2] = bodies.az[i];
+        out[3] = bodies.avx[i], out[4] = bodies.avy[i], out[5] = bodies.avz[i];
+    }
+    if (chunk.frames() >= framesPerChunk_) handOff();
+}
+
+EphemerisRecorder::Statistics EphemerisRecorder::statistics() const {
+    Statistics statistics;
+    statistics.framesRecorded = framesRecorded_.load();
+    statistics.framesDropped = framesDropped_.load();
+    statistics.bodySamples = bodySamples_.load();
+    statistics.bytesWritten = bytesWritten_.load();
+    return statistics;
+}
+
+void EphemerisRecorder::handOff(bool wait) {
+    auto &chunk = buffers_[filling_];
+    if (chunk.frames() == 0) return;
+
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (wait) idle_.wait(lock, [&] { return !pending_ && !writerBusy_; });
+        if (pending_ || writerBusy_) {
+            framesDropped_ += chunk.frames();
+            chunk.clear();
+            return;
+        }
+        framesRecorded_ += chunk.frames();
+        bodySamples_ += chunk.frames() * chunk.bodies();
+        pending_ = true;
+        filling_ = 1 - filling_;
+    }
+    wake_.notify_one();
+    buffers_[filling_].clear();
+}
+
+void EphemerisRecorder::writerLoop() {
+    for (;;) {
+        int buffer;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [&] { return pending_ || stop_; });
+            if (!pending_) return;
+            pending_ = false;
+            writerBusy_ = true;
+            buffer = 1 - filling_;
+        }
+
+        writeChunk(buffers_[buffer]);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            writerBusy_ = false;
+        }
+        idle_.notify_all();
+    }
+}
+
+void EphemerisRecorder::writeChunk(const EphemerisChunk &chunk) {
+    BitWriter bits;
+    for (size_t i = 0; i < chunk.bodies(); i++) {
+        for (size_t c = 0; c < kComponents; c++) {
+            encodeSeries(bits, chunk.states.data() + i * kComponents + c, chunk.frames(), chunk.bodies() * kComponents);
+        }
+    }
+    const auto &payload = bits.finish();
+
+    ChunkHeader header{ static_cast<uint32_t>(chunk.frames()), static_cast<uint32_t>(chunk.bodies()), payload.size() };
+    bool ok = std::fwrite(&header, sizeof(header), 1, file_) == 1;
+    ok = ok && std::fwrite(chunk.times.data(), sizeof(double), chunk.frames(), file_) == chunk.frames();
+    ok = ok && std::fwrite(chunk.entities.data(), sizeof(uint32_t), chunk.bodies(), file_) == chunk.bodies();
+    ok = ok && std::fwrite(payload.data(), 1, payload.size(), file_) == payload.size();
+    if (!ok) failed_ = true;
+    bytesWritten_ += sizeof(header) + chunk.frames() * sizeof(double) + chunk.bodies() * sizeof(uint32_t) + payload.size();
+}
+
+bool readEphemerisFile(const std::string &path, const std::function<void(const EphemerisChunk &)> &fn) {
+    std::FILE *file = std::fopen(path.c_str(), "rb");
+    if (!file) return false;
+    std::fseek(file, 0, SEEK_END);
+    uint64_t fileSize = static_cast<uint64_t>(std::max(std::ftell(file), 0L));
+    std::rewind(file);
+
+    char magic[sizeof(kMagic)];
+    uint32_t version;
+    bool ok = std::fread(magic, sizeof(magic), 1, file) == 1 && std::fread(&version, sizeof(version), 1, file) == 1;
+    ok = ok && std::memcmp(magic, kMagic, sizeof(kMagic)) == 0 && version == kVersion;
+
+    EphemerisChunk chunk;
+    std::vector<uint8_t> payload;
+    ChunkHeader header;
+    while (ok && std::fread(&header, sizeof(header), 1, file) == 1) {
+        // Check the sizes against the rest of the file before allocating for them. Every
+        // sample takes at least one bit of payload.
+        uint64_t remaining = fileSize - std::min<uint64_t>(static_cast<uint64_t>(std::ftell(file)), fileSize);
+        ok = header.payloadSize <= remaining &&
+             uint64_t{ header.frames } * sizeof(double) + uint64_t{ header.bodies } * sizeof(uint32_t) <= remaining - header.payloadSize &&
+             uint64_t{ header.frames } * header.bodies <= header.payloadSize * 8 / kComponents;
+        if (!ok) break;
+
+        chunk.times.resize(header.frames);
+        chunk.entities.resize(header.bodies);
+        chunk.states.resize(size_t{ header.frames } * header.bodies * kComponents);
+        payload.resize(header.payloadSize);
+        ok = std::fread(chunk.times.data(), sizeof(double), header.frames, file) == header.frames &&
+             std::fread(chunk.entities.data(), sizeof(uint32_t), header.bodies, file) == header.bodies &&
+             std::fread(payload.data(), 1, payload.size(), file) == payload.size();
+
+        BitReader bits(payload.data(), payload.size());
+        for (size_t i = 0; ok && i < header.bodies; i++) {
+            for (size_t c = 0; ok && c < kComponents; c++) {
+                ok = decodeSeries(bits, chunk.states.data() + i * kComponents + c, header.frames, header.bodies * kComponents);
+            }
+        }
+        if (ok) fn(chunk);
+    }
+    ok = ok && std::feof(file);
+    std::fclose(file);
+    return ok;
+}
+
+} // namespace sfs::ephemeris
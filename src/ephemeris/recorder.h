@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <entt/entt.hpp>
+
+namespace sfs::ephemeris {
+
+// Frames of absolute body states, kept together so that each body's series compresses
+// as one run
+struct EphemerisChunk {
+    std::vector<double> times;       // Per frame
+    std::vector<uint32_t> entities;  // Per body, entt::to_integral of the entity
+    std::vector<double> states;      // [frame][body][x, y, z, vx, vy, vz]
+
+    size_t frames() const { return times.size(); }
+    size_t bodies() const { return entities.size(); }
+    void clear();
+};
+
+// Records absolute body states every `interval` steps into a file, compressing them on
+// a background thread.
+//
+// Frames are collected into one of two chunk buffers. A full chunk is handed to the
+// writer if it has finished the other buffer, and dropped otherwise, so the physics
+// thread never waits on compression or I/O.
+//
+// The file starts with "SFSEPHM\0" and a u32 version, followed by chunks of
+//   u32 frame count, u32 body count, u64 payload size,
+//   f64 times[frames], u32 entities[bodies], payload
+// in native byte order. The payload holds one encodeSeries run per body and component
+// (x, y, z, vx, vy, vz), body-major.
+class EphemerisRecorder {
+public:
+    struct Statistics {
+        uint64_t framesRecorded = 0;  // Handed to the writer
+        uint64_t framesDropped = 0;   // Lost because the writer was behind
+        uint64_t bodySamples = 0;     // Body states handed to the writer
+        uint64_t bytesWritten = 0;
+
+        double bytesPerBodySample() const { return bodySamples ? static_cast<double>(bytesWritten) / static_cast<double>(bodySamples) : 0.0; }
+    };
+
+    EphemerisRecorder(const std::string &path, unsigned interval = 1, size_t framesPerChunk = 64);
+    ~EphemerisRecorder() { finish(); }
+
+    EphemerisRecorder(const EphemerisRecorder &) = delete;
+    EphemerisRecorder &operator=(const EphemerisRecorder &) = delete;
+
+    // False if the file could not be opened or a write failed
+    bool ok() const { return opened_ && !failed_.load(); }
+
+    // Call after every physics step. Samples the absolute states of the last step every
+    // `interval` calls.
+    void step(entt::registry &registry, double time);
+
+    // Writes the partial chunk, waiting for the writer if needed, and closes the file.
+    // Later steps are ignored.
+    void finish();
+
+    // Counters are updated by the writer as chunks are written
+    Statistics statistics() const;
+
+private:
+    // Passes the filling buffer to the writer, or drops its frames if the writer still
+    // has the other one. Waits for the writer instead if `wait` is set.
+    void handOff(bool wait = false);
+    void writerLoop();
+    void writeChunk(const EphemerisChunk &chunk);
+
+    std::FILE *file_ = nullptr;
+    bool opened_ = false;
+    unsigned interval_;
+    size_t framesPerChunk_;
+    uint64_t steps_ = 0;
+
+    EphemerisChunk buffers_[2];
+    int filling_ = 0;  // Buffer the physics thread writes into
+
+    // Guards the hand-off state below. The writer never holds it while compressing or
+    // writing, so taking it is always brief.
+    std::mutex mutex_;
+    std::condition_variable wake_;  // Signals the writer
+    std::condition_variable idle_;  // Signals the destructor
+    bool pending_ = false;          // Buffer 1 - filling_ waits for the writer
+    bool writerBusy_ = false;       // The writer is still on buffer 1 - filling_
+    bool stop_ = false;
+    std::atomic<bool> failed_{ false };
+
+    std::atomic<uint64_t> framesRecorded_{ 0 };
+    std::atomic<uint64_t> framesDropped_{ 0 };
+    std::atomic<uint64_t> bodySamples_{ 0 };
+    std::atomic<uint64_t> bytesWritten_{ 0 };
+
+    std::thread writer_;
+};
+
+// Calls `fn` with every chunk of a recorded file. Returns false if the file cannot be
+// read or is malformed.
+bool readEphemerisFile(const std::string &path, const std::function<void(const EphemerisChunk &)> &fn);
+
+} // namespace sfs::ephemeris
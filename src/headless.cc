@@ -0,0 +1,268 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include <Eigen/Dense>
+#include <entt/entt.hpp>
+
+#include "ephemeris/chebyshev.h"
+#include "ephemeris/recorder.h"
+#include "model/catalog.h"
+#include "model/checkpoint.h"
+#include "model/solar_system.h"
+#include "physics/encounters.h"
+#include "physics/physics.h"
+#include "util.h"
+
+namespace {
+
+struct HeadlessOptions {
+    long long steps = 100000;
+    double dt = 36000.0;
+    int asteroids = 0;
+    bool testParticles = false;  // Asteroids and catalog bodies are test particles
+    std::string load;  // Checkpoint to start from instead of the built-in scene
+    std::string save;  // Checkpoint to write after the run
+    std::string catalog;  // Minor bodies to add around the root body
+    sfs::model::CatalogFormat catalogFormat = sfs::model::CatalogFormat::Elements;
+    std::string record;  // Ephemeris file to record into
+    unsigned recordInterval = 1;
+    double cacheWindow = 0;  // Chebyshev ephemeris cache window, 0 for none
+    double encounterHillRadii = 0;  // Close encounter radius in Hill radii, 0 to not detect them
+    sfs::physics::PhysicsSettings physics;
+};
+
+void printUsage(const char *program) {
+    std::cerr << "Usage: " << program << " [--steps N] [--dt SECONDS] [--asteroids N] [--test-particles] [--gravity direct|barnes-hut] [--theta ANGLE] [--threads N]"
+              << " [--block-timesteps] [--max-level N] [--no-primary-switching] [--integrator kick-drift|leapfrog|yoshida4|yoshida6] [--corrector 0|3|5|7]"
+              << " [--load CHECKPOINT] [--save CHECKPOINT] [--catalog FILE] [--catalog-format elements|states]"
+              << " [--record EPHEMERIS] [--record-every STEPS] [--cache-window SECONDS] [--encounters HILL_RADII]"
+              << std::endl;
+}
+
+bool parseOptions(int argc, char **argv, HeadlessOptions &options) {
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (std::strcmp(arg, "--steps") == 0 && value) {
+            options.steps = std::strtoll(value, nullptr, 10);
+            i++;
+        } else if (std::strcmp(arg, "--dt") == 0 && value) {
+            options.dt = std::strtod(value, nullptr);
+            i++;
+        } else if (std::strcmp(arg, "--test-particles") == 0) {
+            options.testParticles = true;
+        } else if (std::strcmp(arg, "--asteroids") == 0 && value) {
+            options.asteroids = std::atoi(value);
+            i++;
+        } else if (std::strcmp(arg, "--gravity") == 0 && value) {
+            if (std::strcmp(value, "direct") == 0) {
+                options.physics.gravityMode = sfs::physics::GravityMode::Direct;
+            } else if (std::strcmp(value, "barnes-hut") == 0) {
+                options.physics.gravityMode = sfs::physics::GravityMode::BarnesHut;
+            } else {
+                return false;
+            }
+            i++;
+        } else if (std::strcmp(arg, "--theta") == 0 && value) {
+            options.physics.openingAngle = std::strtod(value, nullptr);
+            i++;
+        } else if (std::strcmp(arg, "--threads") == 0 && value) {
+            options.physics.threadCount = static_cast<unsigned>(std::strtoul(value, nullptr, 10));
+            i++;
+        } else if (std::strcmp(arg, "--integrator") == 0 && value) {
+            if (std::strcmp(value, "kick-drift") == 0) {
+                options.physics.integrator = sfs::physics::Integrator::KickDrift;
+            } else if (std::strcmp(value, "leapfrog") == 0) {
+                options.physics.integrator = sfs::physics::Integrator::Leapfrog;
+            } else if (std::strcmp(value, "yoshida4") == 0) {
+                options.physics.integrator = sfs::physics::Integrator::Yoshida4;
+            } else if (std::strcmp(value, "yoshida6") == 0) {
+                options.physics.integrator = sfs::physics::Integrator::Yoshida6;
+            } else {
+                return false;
+            }
+            i++;
+        } else if (std::strcmp(arg, "--corrector") == 0 && value) {
+            int order = std::atoi(value);
+            if (order != 0 && order != 3 && order != 5 && order != 7) return false;
+            options.physics.correctorOrder = order;
+            i++;
+        } else if (std::strcmp(arg, "--load") == 0 && value) {
+            options.load = value;
+            i++;
+        } else if (std::strcmp(arg, "--save") == 0 && value) {
+            options.save = value;
+            i++;
+        } else if (std::strcmp(arg, "--catalog") == 0 && value) {
+            options.catalog = value;
+            i++;
+        } else if (std::strcmp(arg, "--catalog-format") == 0 && value) {
+            if (std::strcmp(value, "elements") == 0) {
+                options.catalogFormat = sfs::model::CatalogFormat::Elements;
+            } else if (std::strcmp(value, "states") == 0) {
+                options.catalogFormat = sfs::model::CatalogFormat::StateVectors;
+            } else {
+                return false;
+            }
+            i++;
+        } else if (std::strcmp(arg, "--record") == 0 && value) {
+            options.record = value;
+            i++;
+        } else if (std::strcmp(arg, "--record-every") == 0 && value) {
+            options.recordInterval = static_cast<unsigned>(std::strtoul(value, nullptr, 10));
+            i++;
+        } else if (std::strcmp(arg, "--cache-window") == 0 && value) {
+            options.cacheWindow = std::atof(value);
+            i++;
+        } else if (std::strcmp(arg, "--encounters") == 0 && value) {
+            options.encounterHillRadii = std::atof(value);
+            i++;
+        } else if (std::strcmp(arg, "--block-timesteps") == 0) {
+            options.physics.blockTimesteps = true;
+        } else if (std::strcmp(arg, "--no-primary-switching") == 0) {
+            options.physics.primarySwitching = false;
+        } else if (std::strcmp(arg, "--max-level") == 0 && value) {
+            options.physics.maxTimestepLevel = std::atoi(value);
+            i++;
+        } else {
+            return false;
+        }
+    }
+    return options.steps > 0 && options.dt != 0.0 && options.recordInterval > 0 && options.cacheWindow >= 0 && options.encounterHillRadii >= 0 &&
+           (options.cacheWindow == 0 || options.dt > 0) && options.physics.maxTimestepLevel >= 0 && options.physics.maxTimestepLevel < 32;
+}
+
+} // namespace
+
+// Runs the simulation without a window as fast as possible, then reports throughput
+// and how well energy was conserved.
+int main(int argc, char **argv) {
+    HeadlessOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    entt::registry registry;
+    // Before loading, so that the catalog loader can use the thread pool
+    registry.ctx().insert_or_assign(options.physics);
+    double startTime = 0.0;
+    auto loadStart = std::chrono::steady_clock::now();
+    auto sun = options.load.empty() ? sfs::model::createSolarSystem(registry) : sfs::model::loadCheckpoint(registry, options.load, &startTime);
+    if (sun == entt::null) {
+        std::cerr << "Failed to load " << options.load << std::endl;
+        return 1;
+    }
+    if (options.asteroids > 0) sfs::model::createAsteroidBelt(registry, sun, options.asteroids, 0, options.testParticles);
+    if (!options.catalog.empty()) {
+        size_t skipped;
+        size_t loaded = sfs::model::loadCatalog(registry, sun, options.catalog, options.catalogFormat, &skipped, options.testParticles);
+        if (loaded == 0) {
+            std::cerr << "Failed to load " << options.catalog << std::endl;
+            return 1;
+        }
+        std::cout << "Catalog: " << loaded << " bodies (" << skipped << " rows skipped)" << std::endl;
+    }
+    double loadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - loadStart).count();
+
+    long long bodyCount = 0, particleCount = 0;
+    for (auto entity : registry.view<sfs::physics::BodyState, sfs::physics::Body>()) {
+        bodyCount++;
+        if (registry.all_of<sfs::physics::TestParticle>(entity)) particleCount++;
+    }
+
+    double initialEnergy;
+    Eigen::Vector3d initialCOM, initialMomentum, initialAngularMomentum;
+    sfs::physics::calculateConservedQuantities(registry, initialCOM, initialEnergy, initialMomentum, initialAngularMomentum);
+
+    std::unique_ptr<sfs::ephemeris::EphemerisRecorder> recorder;
+    if (!options.record.empty()) {
+        recorder = std::make_unique<sfs::ephemeris::EphemerisRecorder>(options.record, options.recordInterval);
+        if (!recorder->ok()) {
+            std::cerr << "Failed to open " << options.record << std::endl;
+            return 1;
+        }
+    }
+
+    std::unique_ptr<sfs::ephemeris::ChebyshevEphemeris> cache;
+    if (options.cacheWindow > 0) cache = std::make_unique<sfs::ephemeris::ChebyshevEphemeris>(options.cacheWindow);
+
+    // The closest encounter is kept and the rest of the queue dropped
+    size_t encounters = 0;
+    sfs::physics::EncounterEvent closestEncounter{ entt::null, entt::null, 0.0, INFINITY };
+    auto &encounterQueue = registry.ctx().emplace<sfs::physics::EncounterQueue>().events;
+    if (options.encounterHillRadii > 0) sfs::physics::detectEncounters(registry, startTime, options.encounterHillRadii);
+
+    auto start = std::chrono::steady_clock::now();
+    for (long long i = 0; i < options.steps; i++) {
+        sfs::physics::physicsUpdate(registry, options.dt);
+        double time = startTime + static_cast<double>(i + 1) * options.dt;
+        if (recorder) recorder->step(registry, time);
+        if (cache) cache->step(registry, time);
+        if (options.encounterHillRadii > 0) {
+            encounters += sfs::physics::detectEncounters(registry, time, options.encounterHillRadii);
+            for (const auto &event : encounterQueue) {
+                if (event.distance < closestEncounter.distance) closestEncounter = event;
+            }
+            encounterQueue.clear();
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    if (recorder) recorder->finish();
+
+    double energy;
+    Eigen::Vector3d com, momentum, angularMomentum;
+    sfs::physics::calculateConservedQuantities(registry, com, energy, momentum, angularMomentum);
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    double simulatedTime = static_cast<double>(options.steps) * options.dt;
+    std::string formattedTime = formatDuration(std::chrono::seconds(static_cast<long long>(std::fabs(simulatedTime))));
+
+    std::cout << "Bodies: " << bodyCount << " (" << particleCount << " test particles, scene set up in " << loadSeconds << " s)" << std::endl;
+    std::cout << "Steps: " << options.steps << " (dt = " << options.dt << " s, simulated " << formattedTime << ")" << std::endl;
+    std::cout << "Wall time: " << seconds << " s" << std::endl;
+    std::cout << "Steps/sec: " << static_cast<double>(options.steps) / seconds << std::endl;
+    std::cout << "ns per body-step: " << seconds * 1e9 / (static_cast<double>(options.steps) * static_cast<double>(bodyCount)) << std::endl;
+    const auto &statistics = registry.ctx().get<sfs::physics::PhysicsStatistics>();
+    std::cout << "Sub-steps: " << statistics.subSteps << ", force evaluations per body-step: "
+              << static_cast<double>(statistics.forceEvaluations) / (static_cast<double>(options.steps) * static_cast<double>(bodyCount))
+              << std::endl;
+    if (statistics.primarySwitches > 0) std::cout << "Primary switches: " << statistics.primarySwitches << std::endl;
+    if (recorder) {
+        auto statistics = recorder->statistics();
+        std::cout << "Recorded frames: " << statistics.framesRecorded << " (" << statistics.framesDropped << " dropped), "
+                  << statistics.bytesPerBodySample() << " bytes/body-step" << (recorder->ok() ? "" : ", write failed") << std::endl;
+    }
+    if (cache) {
+        const auto &statistics = cache->statistics();
+        std::cout << "Ephemeris cache: " << statistics.windows << " windows, "
+                  << static_cast<double>(statistics.bytes) / static_cast<double>(std::max<size_t>(statistics.bodySamples, 1)) << " bytes/body-step, "
+                  << "max error bound " << statistics.maxErrorBound << " m" << std::endl;
+    }
+    if (options.encounterHillRadii > 0) {
+        std::cout << "Encounters: " << encounters;
+        if (encounters > 0) {
+            std::cout << ", closest " << closestEncounter.distance << " m between entities " << entt::to_integral(closestEncounter.first) << " and "
+                      << entt::to_integral(closestEncounter.second) << " at " << closestEncounter.time << " s";
+        }
+        std::cout << std::endl;
+    }
+    std::cout << "Energy drift: " << energy - initialEnergy << " J (relative " << (energy - initialEnergy) / std::fabs(initialEnergy) << ")"
+              << std::endl;
+
+    if (!std::isfinite(energy)) {
+        std::cerr << "Energy is not finite" << std::endl;
+        return 1;
+    }
+    if (!options.save.empty() && !sfs::model::saveCheckpoint(registry, options.save, startTime + simulatedTime)) {
+        std::cerr << "Failed to save " << options.save << std::endl;
+        return 1;
+    }
+    return 0;
+}
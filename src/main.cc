@@ -6,82 +6,122 @@
 #include <entt/entt.hpp>
 #include <imgui.h>
 
+#include "model/checkpoint.h"
 #include "model/solar_system.h"
+#include "physics/diagnostics.h"
 #include "physics/kepler.h"
 #include "physics/physics.h"
 #include "render/init.h"
 #include "render/scene/camera.h"
+#include "render/scene/snapshot.h"
 #include "render/gl/window.h"
+#include "simulation_thread.h"
 #include "util.h"
 
-int main() {
+namespace {
+
+constexpr double kStepSize = 3600.0;  // Simulated seconds per physics step, about 650 per lunar orbit
+constexpr double kDefaultWarp = 1e6;  // Simulated seconds per wall-clock second
+
+void drawTimeWarp(const sfs::render::SceneSnapshot &scene, sfs::SimulationThread &simulation) {
+    auto warp = static_cast<float>(simulation.warp());
+    if (ImGui::SliderFloat("Time warp", &warp, 1.0f, 1e9f, "%.3g", ImGuiSliderFlags_Logarithmic)) simulation.setWarp(warp);
+    auto budget = static_cast<float>(simulation.budget() * 1e3);
+    if (ImGui::SliderFloat("Compute budget (ms)", &budget, 1.0f, 16.0f, "%.1f")) simulation.setBudget(budget * 1e-3);
+    ImGui::Text("Achieved warp: %.3g%s", scene.achievedWarp, scene.computeLimited ? " (compute limited)" : "");
+}
+
+// Conserved quantities come from the monitor's worker, so the panel only costs a copy of
+// the states now and then, and nothing while it is collapsed
+void drawDiagnostics(const sfs::render::SceneSnapshot &scene, sfs::physics::ConservedQuantityMonitor &diagnostics,
+                     const sfs::physics::ConservedQuantities &initial) {
+    auto refresh = static_cast<float>(diagnostics.refreshInterval());
+    if (ImGui::SliderFloat("Refresh interval (s)", &refresh, 0.05f, 5.0f, "%.2f")) diagnostics.setRefreshInterval(refresh);
+
+    sfs::physics::ConservedQuantities q;
+    if (!diagnostics.latest(q)) {
+        ImGui::Text("Computing...");
+        return;
+    }
+    ImGui::Text("Center of Mass: [%.3e, %.3e, %.3e] m", q.com.x(), q.com.y(), q.com.z());
+    ImGui::Text("Total Energy: %.3e J%s", q.energy, q.kernelPotential ? " (kernel potential)" : "");
+    ImGui::Text("Total Momentum: [%.3e, %.3e, %.3e] kg·m/s", q.momentum.x(), q.momentum.y(), q.momentum.z());
+    ImGui::Text("Total Angular Momentum: [%.3e, %.3e, %.3e] kg·m²/s", q.angularMomentum.x(), q.angularMomentum.y(), q.angularMomentum.z());
+
+    Eigen::Vector3d momentumDrift = q.momentum - initial.momentum;
+    Eigen::Vector3d angularMomentumDrift = q.angularMomentum - initial.angularMomentum;
+    ImGui::Text("Energy Drift: %.3e J", q.energy - initial.energy);
+    ImGui::Text("Momentum Drift: [%.3e, %.3e, %.3e] kg·m/s", momentumDrift.x(), momentumDrift.y(), momentumDrift.z());
+    ImGui::Text("Angular Momentum Drift: [%.3e, %.3e, %.3e] kg·m²/s", angularMomentumDrift.x(), angularMomentumDrift.y(), angularMomentumDrift.z());
+
+    int32_t sun = scene.itemOf(static_cast<entt::entity>(0));
+    if (sun >= 0) ImGui::Text("Sun Velocity: [%.3e, %.3e, %.3e] m", scene.velocity[sun].x(), scene.velocity[sun].y(), scene.velocity[sun].z());
+}
+
+} // namespace
+
+// Usage: relativistic_sfs [CHECKPOINT], starting from the checkpoint if given
+int main(int argc, char **argv) {
     std::cout << "Hello, World!" << std::endl;
 
     entt::registry registry;
     std::unique_ptr<sfs::render::MainWindow> window = sfs::render::MainWindow::create();
 
-    sfs::model::createSolarSystem(registry);
-
-    auto camera = registry.create();
-    {
-        auto &cameraData = registry.emplace<sfs::render::Camera>(camera);
-        cameraData.target = entt::null;
-        cameraData.distance = 1.0e12;
-        cameraData.yaw = 0.0;
-        cameraData.pitch = M_PI / 6.0;
+    double time = 0.0;
+    if (argc > 1) {
+        if (sfs::model::loadCheckpoint(registry, argv[1], &time) == entt::null) {
+            std::cerr << "Failed to load " << argv[1] << std::endl;
+            return 1;
+        }
+    } else {
+        sfs::model::createSolarSystem(registry);
     }
 
+    sfs::render::Camera camera;
+    camera.target = entt::null;
+    camera.distance = 1.0e12;
+    camera.yaw = 0.0;
+    camera.pitch = M_PI / 6.0;
+    camera.viewMatrix = Eigen::Matrix4f::Identity();
+    camera.projectionMatrix = Eigen::Matrix4f::Identity();
+
     initCameraGLFWCallbacks(*window);
     window->initImGui();
 
-    double time = 0.0;
     sfs::render::initRenderSystem();
 
-    double initialEnergy;
-    Eigen::Vector3d initialCOM, initialMomentum, initialAngularMomentum;
-    sfs::physics::calculateConservedQuantities(registry, initialCOM, initialEnergy, initialMomentum, initialAngularMomentum);
+    sfs::physics::ConservedQuantities initial;
+    sfs::physics::calculateConservedQuantities(registry, initial.com, initial.energy, initial.momentum, initial.angularMomentum);
+
+    // From here on the registry belongs to the simulation thread
+    sfs::SimulationThread simulation(registry, time, kStepSize, kDefaultWarp);
+    sfs::render::SceneFrame frame;
+    auto lastFrame = std::chrono::steady_clock::now();
 
     // Game loop
     while (!window->shouldClose()) {
         window->startFrame();
 
-        constexpr double dt = 36000.0;
-        sfs::physics::physicsUpdate(registry, dt);
-        updateCameras(registry, *window, 1.0 / 144.0);
-        sfs::render::renderBodies(registry, camera);
-        sfs::render::renderDots(registry, camera);
-        sfs::render::renderTrajectories(registry, camera);
+        auto now = std::chrono::steady_clock::now();
+        double frameTime = std::chrono::duration<double>(now - lastFrame).count();
+        lastFrame = now;
+
+        simulation.scenes().update();
+        const auto &scene = simulation.scenes().front();
+        sfs::render::interpolateScene(scene, now, frame);
+        updateCamera(camera, scene, frame, *window, frameTime);
+        sfs::render::renderBodies(scene, frame, camera);
+        sfs::render::renderDots(scene, frame, camera);
+        sfs::render::renderTrajectories(scene, frame, camera);
 
-        time += dt;
-        std::string formattedTime = formatDuration(std::chrono::seconds(static_cast<long long>(time)));
+        std::string formattedTime = formatDuration(std::chrono::seconds(static_cast<long long>(scene.time)));
         ImGui::Text("Simulated time: %s", formattedTime.c_str());
+        drawTimeWarp(scene, simulation);
+        if (ImGui::Button("Save checkpoint")) simulation.requestCheckpoint("checkpoint.sfsckpt");
 
-        double energy;
-        Eigen::Vector3d com, momentum, angularMomentum;
-        sfs::physics::calculateConservedQuantities(registry, com, energy, momentum, angularMomentum);
-        ImGui::Text("Center of Mass: [%.3e, %.3e, %.3e] m", com.x(), com.y(), com.z());
-        ImGui::Text("Total Energy: %.3e J", energy);
-        ImGui::Text("Total Momentum: [%.3e, %.3e, %.3e] kg·m/s", momentum.x(), momentum.y(), momentum.z());
-        ImGui::Text("Total Angular Momentum: [%.3e, %.3e, %.3e] kg·m²/s", angularMomentum.x(), angularMomentum.y(), angularMomentum.z());
-
-        ImGui::Text("Energy Drift: %.3e J", energy - initialEnergy);
-        ImGui::Text("Momentum Drift: [%.3e, %.3e, %.3e] kg·m/s",
-            momentum.x() - initialMomentum.x(),
-            momentum.y() - initialMomentum.y(),
-            momentum.z() - initialMomentum.z()
-        );
-        ImGui::Text("Angular Momentum Drift: [%.3e, %.3e, %.3e] kg·m²/s",
-            angularMomentum.x() - initialAngularMomentum.x(),
-            angularMomentum.y() - initialAngularMomentum.y(),
-            angularMomentum.z() - initialAngularMomentum.z()
-        );
-
-        entt::entity sun = static_cast<entt::entity>(0);
-        ImGui::Text("Sun Velocity: [%.3e, %.3e, %.3e] m",
-            registry.get<sfs::physics::BodyState>(sun).st.vel.x(),
-            registry.get<sfs::physics::BodyState>(sun).st.vel.y(),
-            registry.get<sfs::physics::BodyState>(sun).st.vel.z()
-        );
+        bool diagnosticsVisible = ImGui::CollapsingHeader("Diagnostics");
+        simulation.setDiagnosticsVisible(diagnosticsVisible);
+        if (diagnosticsVisible) drawDiagnostics(scene, simulation.diagnostics(), initial);
 
         window->endFrame();
     }
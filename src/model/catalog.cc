@@ -0,0 +1,174 @@
+#include "catalog.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "model/mapped_file.h"
+#include "physics/kepler.h"
+#include "physics/parallel.h"
+#include "physics/physics.h"
+#include "render/scene/dot.h"
+
+namespace sfs::model {
+
+namespace {
+
+constexpr double kAstronomicalUnit = 1.495978707e11;  // m
+constexpr double kDefaultMass = 1e15;                  // kg, the low end of createAsteroidBelt
+constexpr size_t kChunkBytes = size_t{ 1 } << 20;
+constexpr int kMaxFields = 8;
+
+// Bodies parsed from one chunk of the file
+struct ParsedChunk {
+    std::vector<physics::BodyState> states;
+    std::vector<physics::Body> bodies;
+    std::vector<physics::KeplerParameters> kepler;
+    size_t skipped = 0;
+};
+
+bool isSeparator(char c) {
+    return c == ' ' || c == '\t' || c == ',' || c == '\r';
+}
+
+// Parses the numeric fields of a line into `out`. Returns the field count, or -1 if a
+// field is not a number or there are more than `max`.
+int parseFields(const char *begin, const char *end, double *out, int max) {
+    int count = 0;
+    for (const char *p = begin;;) {
+        while (p < end && isSeparator(*p)) p++;
+        if (p == end) return count;
+        if (count == max) return -1;
+        // from_chars rejects a leading '+', which some catalogs write
+        if (*p == '+') p++;
+        auto [next, error] = std::from_chars(p, end, out[count]);
+        if (error != std::errc() || (next < end && !isSeparator(*next))) return -1;
+        count++;
+        p = next;
+    }
+}
+
+// Elliptic elements to a state relative to the primary, in the ecliptic frame
+bool elementsToState(const double *fields, double mu, Eigen::Vector3d &position, Eigen::Vector3d &velocity) {
+    double a = fields[0] * kAstronomicalUnit, e = fields[1];
+    if (!(a > 0.0) || !(e >= 0.0 && e < 1.0)) return false;
+    constexpr double kRadians = M_PI / 180.0;
+    double i = fields[2] * kRadians, node = fields[3] * kRadians, periapsis = fields[4] * kRadians;
+    double M = std::remainder(fields[5] * kRadians, 2.0 * M_PI);
+
+    // Newton's method on Kepler's equation, started at pi for high eccentricities
+    double E = e < 0.8 ? M : (M < 0.0 ? -M_PI : M_PI);
+    for (int iteration = 0; iteration < 30; iteration++) {
+        double delta = (E - e * std::sin(E) - M) / (1.0 - e * std::cos(E));
+        E -= delta;
+        if (std::fabs(delta) < 1e-14) break;
+    }
+
+    double cosE = std::cos(E), sinE = std::sin(E);
+    double b = a * std::sqrt(1.0 - e * e);
+    double rate = std::sqrt(mu / a) / (a * (1.0 - e * cosE));  // dE/dt
+    Eigen::Vector3d perifocalPosition(a * (cosE - e), b * sinE, 0.0);
+    Eigen::Vector3d perifocalVelocity(-a * sinE * rate, b * cosE * rate, 0.0);
+
+    Eigen::Matrix3d rotation = (Eigen::AngleAxisd(node, Eigen::Vector3d::UnitZ()) * Eigen::AngleAxisd(i, Eigen::Vector3d::UnitX()) *
+                                Eigen::AngleAxisd(periapsis, Eigen::Vector3d::UnitZ())).toRotationMatrix();
+    position = rotation * perifocalPosition;
+    velocity = rotation * perifocalVelocity;
+    return true;
+}
+
+void parseChunk(const char *begin, const char *end, CatalogFormat format, entt::entity primary, double mu, ParsedChunk &out) {
+    double fields[kMaxFields];
+    for (const char *line = begin; line < end;) {
+        const char *lineEnd = static_cast<const char *>(std::memchr(line, '\n', static_cast<size_t>(end - line)));
+        if (!lineEnd) lineEnd = end;
+        const char *next = lineEnd < end ? lineEnd + 1 : end;
+
+        const char *first = line;
+        while (first < lineEnd && isSeparator(*first)) first++;
+        if (first == lineEnd || *first == '#') {
+            line = next;
+            continue;
+        }
+
+        int count = parseFields(first, lineEnd, fields, kMaxFields);
+        Eigen::Vector3d position, velocity;
+        // from_chars takes nan and inf, which would poison every force they enter. A zero
+        // mass would divide the kick by zero, and a negative one is not physical.
+        bool ok = (count == 6 || (count == 7 && fields[6] > 0.0)) && std::all_of(fields, fields + count, [](double f) { return std::isfinite(f); });
+        if (ok && format == CatalogFormat::Elements) {
+            ok = elementsToState(fields, mu, position, velocity);
+        } else if (ok) {
+            position = Eigen::Vector3d(fields[0], fields[1], fields[2]) * 1e3;
+            velocity = Eigen::Vector3d(fields[3], fields[4], fields[5]) * 1e3;
+        }
+        // A body on top of its primary has no Kepler orbit and an infinite pull
+        ok = ok && position.allFinite() && velocity.allFinite() && position.norm() > 0.0;
+        if (!ok) {
+            out.skipped++;
+            line = next;
+            continue;
+        }
+
+        // Swap y and z, like createBodyFromJPL
+        position = Eigen::Vector3d(position.x(), position.z(), position.y());
+        velocity = Eigen::Vector3d(velocity.x(), velocity.z(), velocity.y());
+        out.states.push_back(physics::BodyState{ physics::PhysicsState{ primary, position, velocity } });
+        out.bodies.push_back(physics::Body{ count == 7 ? fields[6] : kDefaultMass });
+        out.kepler.push_back(physics::calculateKeplerParameters(position, velocity, mu));
+        line = next;
+    }
+}
+
+} // namespace
+
+size_t loadCatalog(entt::registry &registry, entt::entity primary, const std::string &path, CatalogFormat format, size_t *skipped,
+                   bool testParticles) {
+    if (skipped) *skipped = 0;
+    MappedFile file(path);
+    if (!file.data()) return 0;
+
+    // Chunks start after the first line break at or past each multiple of kChunkBytes
+    std::vector<const char *> boundaries{ file.data() };
+    const char *fileEnd = file.data() + file.size();
+    for (size_t offset = kChunkBytes; offset < file.size(); offset += kChunkBytes) {
+        const char *start = std::max(file.data() + offset, boundaries.back());
+        const char *lineBreak = static_cast<const char *>(std::memchr(start, '\n', static_cast<size_t>(fileEnd - start)));
+        if (!lineBreak) break;
+        if (lineBreak + 1 > boundaries.back()) boundaries.push_back(lineBreak + 1);
+    }
+    boundaries.push_back(fileEnd);
+
+    double mu = physics::kGravitationalConstant * registry.get<physics::Body>(primary).mass;
+    std::vector<ParsedChunk> chunks(boundaries.size() - 1);
+    physics::parallelFor(physics::getPhysicsThreadPool(registry), 0, chunks.size(), 1, [&](size_t first, size_t last) {
+        for (size_t c = first; c < last; c++) parseChunk(boundaries[c], boundaries[c + 1], format, primary, mu, chunks[c]);
+    });
+
+    size_t count = 0;
+    for (const auto &chunk : chunks) {
+        count += chunk.states.size();
+        if (skipped) *skipped += chunk.skipped;
+    }
+    if (count == 0) return 0;
+
+    std::vector<entt::entity> entities(count);
+    registry.create(entities.begin(), entities.end());
+    size_t offset = 0;
+    for (const auto &chunk : chunks) {
+        auto first = entities.begin() + static_cast<ptrdiff_t>(offset);
+        auto last = first + static_cast<ptrdiff_t>(chunk.states.size());
+        registry.insert<physics::BodyState>(first, last, chunk.states.begin());
+        registry.insert<physics::Body>(first, last, chunk.bodies.begin());
+        registry.insert<physics::KeplerParameters>(first, last, chunk.kepler.begin());
+        offset += chunk.states.size();
+    }
+    registry.insert<physics::ForceAccumulator>(entities.begin(), entities.end(), physics::ForceAccumulator{ Eigen::Vector3d::Zero() });
+    registry.insert<render::RenderDot>(entities.begin(), entities.end(), render::RenderDot{ 0.007f });
+    if (testParticles) registry.insert<physics::TestParticle>(entities.begin(), entities.end());
+    return count;
+}
+
+} // namespace sfs::model
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include <entt/entt.hpp>
+
+namespace sfs::model {
+
+enum class CatalogFormat {
+    // a [AU], e, i, node, argument of periapsis, mean anomaly [deg], then optional mass [kg].
+    // Only elliptic orbits, e < 1.
+    Elements,
+    // x, y, z [km], vx, vy, vz [km/s], then optional mass [kg], in the ecliptic frame
+    // of the JPL data in createSolarSystem
+    StateVectors,
+};
+
+// Loads a text catalog of minor bodies orbiting `primary`, one per row, with fields
+// separated by whitespace or commas. Empty lines and lines starting with '#' are
+// ignored. Rows that do not parse, such as a CSV header, are skipped and counted in
+// `skipped` if given, and so are rows with a non-finite field, a mass that is not
+// positive or a position on top of `primary`. Bodies without a mass get 1e15 kg.
+//
+// The file is mapped and cut into chunks at line breaks, which the physics thread pool
+// parses and converts to states and Kepler parameters in parallel. The bodies are then
+// created with one bulk insert per component, in file order.
+//
+// The bodies are test particles if `testParticles` is set. Returns the number of bodies
+// added, or 0 if the file cannot be read.
+size_t loadCatalog(entt::registry &registry, entt::entity primary, const std::string &path, CatalogFormat format, size_t *skipped = nullptr,
+                   bool testParticles = false);
+
+} // namespace sfs::model
@@ -0,0 +1,266 @@
+#include "checkpoint.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+#include "model/mapped_file.h"
+#include "physics/kepler.h"
+#include "physics/physics.h"
+#include "render/scene/body.h"
+#include "render/scene/dot.h"
+#include "render/scene/trajectory.h"
+
+namespace sfs::model {
+
+namespace {
+
+constexpr char kMagic[8] = { 'S', 'F', 'S', 'C', 'K', 'P', 'T', '\0' };
+constexpr uint32_t kVersion = 2;
+constexpr uint64_t kSectionAlignment = 64;
+
+enum class Section : uint32_t {
+    BodyState,
+    Body,
+    ForceAccumulator,
+    KeplerParameters,
+    KeplerSolverState,
+    RenderBody,
+    RenderDot,
+    RenderTrajectory,
+    TestParticle,
+    Count,
+};
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t sectionCount;
+    uint64_t bodyCount;
+    double time;
+};
+
+struct SectionEntry {
+    uint32_t section;
+    uint32_t recordSize;  // 0 for empty components, which have no data
+    uint64_t count;
+    uint64_t indexOffset;  // Body indices as uint32, or 0 if the component is required on every body
+    uint64_t dataOffset;
+};
+
+// Stored in place of the primary index of root bodies
+constexpr uint32_t kNoPrimary = UINT32_MAX;
+
+uint64_t alignUp(uint64_t offset) {
+    return (offset + kSectionAlignment - 1) / kSectionAlignment * kSectionAlignment;
+}
+
+int depthOf(entt::registry &registry, entt::entity entity) {
+    int depth = 0;
+    for (auto cur = registry.get<physics::BodyState>(entity).st.primary; cur != entt::null; cur = registry.get<physics::BodyState>(cur).st.primary) {
+        depth++;
+    }
+    return depth;
+}
+
+// Pending section of the file being written
+struct SectionData {
+    SectionEntry entry;
+    bool optional;  // Has an index table, even when no body carries the component
+    std::vector<uint32_t> indices;
+    std::vector<char> data;
+};
+
+template<typename T>
+void appendRecord(SectionData &section, const T &record) {
+    const char *bytes = reinterpret_cast<const char *>(&record);
+    section.data.insert(section.data.end(), bytes, bytes + sizeof(T));
+    section.entry.count++;
+}
+
+template<typename T>
+SectionData collectSection(entt::registry &registry, Section section, const std::vector<entt::entity> &bodies, bool optional) {
+    SectionData out{ SectionEntry{ static_cast<uint32_t>(section), std::is_empty_v<T> ? 0u : static_cast<uint32_t>(sizeof(T)), 0, 0, 0 }, optional, { }, { } };
+    for (size_t i = 0; i < bodies.size(); i++) {
+        if (!registry.all_of<T>(bodies[i])) continue;
+        if (optional) out.indices.push_back(static_cast<uint32_t>(i));
+        if constexpr (std::is_empty_v<T>) {
+            out.entry.count++;
+        } else {
+            appendRecord(out, registry.get<T>(bodies[i]));
+        }
+    }
+    return out;
+}
+
+bool validSection(const MappedFile &file, const SectionEntry &entry, uint64_t bodyCount, uint32_t recordSize) {
+    if (entry.recordSize != recordSize || entry.count > bodyCount) return false;
+    if (entry.dataOffset % kSectionAlignment != 0 || !file.contains(entry.dataOffset, entry.count * recordSize)) return false;
+    if (entry.indexOffset == 0) return entry.count == bodyCount;
+    if (entry.indexOffset % alignof(uint32_t) != 0 || !file.contains(entry.indexOffset, entry.count * sizeof(uint32_t))) return false;
+    const auto *indices = reinterpret_cast<const uint32_t *>(file.data() + entry.indexOffset);
+    return std::all_of(indices, indices + entry.count, [&](uint32_t index) { return index < bodyCount; });
+}
+
+// Emplaces the section's components on their bodies in one bulk insert
+template<typename T>
+void insertSection(entt::registry &registry, const MappedFile &file, const SectionEntry &entry, const std::vector<entt::entity> &entities) {
+    std::vector<entt::entity> targets;
+    if (entry.indexOffset == 0) {
+        targets = entities;
+    } else {
+        const auto *indices = reinterpret_cast<const uint32_t *>(file.data() + entry.indexOffset);
+        targets.resize(entry.count);
+        for (size_t k = 0; k < entry.count; k++) targets[k] = entities[indices[k]];
+    }
+
+    if constexpr (std::is_empty_v<T>) {
+        registry.insert<T>(targets.begin(), targets.end());
+    } else {
+        const auto *records = reinterpret_cast<const T *>(file.data() + entry.dataOffset);
+        registry.insert<T>(targets.begin(), targets.end(), records);
+    }
+}
+
+} // namespace
+
+bool saveCheckpoint(entt::registry &registry, const std::string &path, double time) {
+    // Parents first, so that loading can resolve every primary to an earlier body
+    std::vector<std::pair<int, entt::entity>> order;
+    for (auto entity : registry.view<physics::BodyState, physics::Body>()) order.emplace_back(depthOf(registry, entity), entity);
+    std::sort(order.begin(), order.end());
+    std::vector<entt::entity> bodies;
+    std::vector<int64_t> indexOf;
+    for (auto [depth, entity] : order) {
+        auto id = entt::to_entity(entity);
+        if (indexOf.size() <= id) indexOf.resize(id + 1, -1);
+        indexOf[id] = static_cast<int64_t>(bodies.size());
+        bodies.push_back(entity);
+    }
+
+    std::vector<SectionData> sections;
+    // BodyState records carry the primary's index in place of the entity
+    SectionData states{ SectionEntry{ static_cast<uint32_t>(Section::BodyState), sizeof(physics::PhysicsState), 0, 0, 0 }, false, { }, { } };
+    for (auto entity : bodies) {
+        physics::PhysicsState state = registry.get<physics::BodyState>(entity).st;
+        uint32_t primary = state.primary == entt::null ? kNoPrimary : static_cast<uint32_t>(indexOf[entt::to_entity(state.primary)]);
+        state.primary = static_cast<entt::entity>(primary);
+        appendRecord(states, state);
+    }
+    sections.push_back(std::move(states));
+    sections.push_back(collectSection<physics::Body>(registry, Section::Body, bodies, false));
+    sections.push_back(collectSection<physics::ForceAccumulator>(registry, Section::ForceAccumulator, bodies, true));
+    sections.push_back(collectSection<physics::KeplerParameters>(registry, Section::KeplerParameters, bodies, true));
+    sections.push_back(collectSection<physics::KeplerSolverState>(registry, Section::KeplerSolverState, bodies, true));
+    sections.push_back(collectSection<render::RenderBody>(registry, Section::RenderBody, bodies, true));
+    sections.push_back(collectSection<render::RenderDot>(registry, Section::RenderDot, bodies, true));
+    sections.push_back(collectSection<render::RenderTrajectory>(registry, Section::RenderTrajectory, bodies, true));
+    sections.push_back(collectSection<physics::TestParticle>(registry, Section::TestParticle, bodies, true));
+
+    // Lay out every section before writing, so the file goes out front to back
+    uint64_t offset = sizeof(Header) + sections.size() * sizeof(SectionEntry);
+    for (auto &section : sections) {
+        if (section.optional) {
+            section.entry.indexOffset = alignUp(offset);
+            offset = section.entry.indexOffset + section.indices.size() * sizeof(uint32_t);
+        }
+        section.entry.dataOffset = alignUp(offset);
+        offset = section.entry.dataOffset + section.data.size();
+    }
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+
+    Header header{ };
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.sectionCount = static_cast<uint32_t>(sections.size());
+    header.bodyCount = bodies.size();
+    header.time = time;
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    for (const auto &section : sections) out.write(reinterpret_cast<const char *>(&section.entry), sizeof(section.entry));
+
+    uint64_t written = sizeof(Header) + sections.size() * sizeof(SectionEntry);
+    auto padTo = [&](uint64_t target) {
+        static const char zeros[kSectionAlignment] = { };
+        out.write(zeros, static_cast<std::streamsize>(target - written));
+        written = target;
+    };
+    for (const auto &section : sections) {
+        if (section.optional) {
+            padTo(section.entry.indexOffset);
+            out.write(reinterpret_cast<const char *>(section.indices.data()), static_cast<std::streamsize>(section.indices.size() * sizeof(uint32_t)));
+            written += section.indices.size() * sizeof(uint32_t);
+        }
+        padTo(section.entry.dataOffset);
+        out.write(section.data.data(), static_cast<std::streamsize>(section.data.size()));
+        written += section.data.size();
+    }
+    return static_cast<bool>(out);
+}
+
+entt::entity loadCheckpoint(entt::registry &registry, const std::string &path, double *time) {
+    MappedFile file(path);
+    if (!file.data() || !file.contains(0, sizeof(Header))) return entt::null;
+
+    Header header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion) return entt::null;
+    if (!file.contains(sizeof(Header), uint64_t{ header.sectionCount } * sizeof(SectionEntry))) return entt::null;
+
+    // Every known section must be present and sized for this build
+    const uint32_t recordSizes[] = {
+        sizeof(physics::PhysicsState), sizeof(physics::Body), sizeof(physics::ForceAccumulator), sizeof(physics::KeplerParameters),
+        sizeof(physics::KeplerSolverState), sizeof(render::RenderBody), sizeof(render::RenderDot), 0, 0,
+    };
+    static_assert(std::size(recordSizes) == static_cast<size_t>(Section::Count));
+    SectionEntry entries[static_cast<size_t>(Section::Count)];
+    bool found[static_cast<size_t>(Section::Count)] = { };
+    for (uint32_t s = 0; s < header.sectionCount; s++) {
+        SectionEntry entry;
+        std::memcpy(&entry, file.data() + sizeof(Header) + s * sizeof(SectionEntry), sizeof(entry));
+        if (entry.section >= static_cast<uint32_t>(Section::Count)) continue;
+        if (!validSection(file, entry, header.bodyCount, recordSizes[entry.section])) return entt::null;
+        entries[entry.section] = entry;
+        found[entry.section] = true;
+    }
+    if (!std::all_of(std::begin(found), std::end(found), [](bool f) { return f; })) return entt::null;
+
+    const auto &stateEntry = entries[static_cast<size_t>(Section::BodyState)];
+    const auto *records = reinterpret_cast<const physics::PhysicsState *>(file.data() + stateEntry.dataOffset);
+    for (uint64_t i = 0; i < header.bodyCount; i++) {
+        uint32_t primary = static_cast<uint32_t>(records[i].primary);
+        if (primary != kNoPrimary && primary >= i) return entt::null;
+    }
+
+    std::vector<entt::entity> entities(header.bodyCount);
+    registry.create(entities.begin(), entities.end());
+
+    // BodyState is the only section that needs rewriting, to turn indices back into entities
+    std::vector<physics::BodyState> states(header.bodyCount);
+    for (uint64_t i = 0; i < header.bodyCount; i++) {
+        uint32_t primary = static_cast<uint32_t>(records[i].primary);
+        states[i].st = records[i];
+        states[i].st.primary = primary == kNoPrimary ? entt::entity(entt::null) : entities[primary];
+    }
+    registry.insert<physics::BodyState>(entities.begin(), entities.end(), states.begin());
+
+    insertSection<physics::Body>(registry, file, entries[static_cast<size_t>(Section::Body)], entities);
+    insertSection<physics::ForceAccumulator>(registry, file, entries[static_cast<size_t>(Section::ForceAccumulator)], entities);
+    insertSection<physics::KeplerParameters>(registry, file, entries[static_cast<size_t>(Section::KeplerParameters)], entities);
+    insertSection<physics::KeplerSolverState>(registry, file, entries[static_cast<size_t>(Section::KeplerSolverState)], entities);
+    insertSection<render::RenderBody>(registry, file, entries[static_cast<size_t>(Section::RenderBody)], entities);
+    insertSection<render::RenderDot>(registry, file, entries[static_cast<size_t>(Section::RenderDot)], entities);
+    insertSection<render::RenderTrajectory>(registry, file, entries[static_cast<size_t>(Section::RenderTrajectory)], entities);
+    insertSection<physics::TestParticle>(registry, file, entries[static_cast<size_t>(Section::TestParticle)], entities);
+
+    if (time) *time = header.time;
+    auto root = std::find_if(states.begin(), states.end(), [](const physics::BodyState &state) { return state.st.primary == entt::null; });
+    return root == states.end() ? entt::entity(entt::null) : entities[root - states.begin()];
+}
+
+} // namespace sfs::model
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+
+#include <entt/entt.hpp>
+
+namespace sfs::model {
+
+// Binary snapshot of every body: BodyState with its hierarchy, Body, ForceAccumulator,
+// KeplerParameters, KeplerSolverState, TestParticle and the render components.
+//
+// The file is a header, a section table and one section per component, each an array
+// of the component's in-memory representation aligned for direct use. Sections of
+// optional components are preceded by the indices of the bodies carrying them. Bodies
+// are stored parents first, and a BodyState's primary holds the index of the primary
+// body instead of an entity.
+//
+// NB: Records are raw structs in native byte order, so a file only loads on builds with
+// the same component layouts. The header records each record size and loading checks
+// them.
+
+// Writes the snapshot with one sequential write. `time` is the simulated time to store
+// alongside, if the caller tracks one. Returns false if the file cannot be written.
+bool saveCheckpoint(entt::registry &registry, const std::string &path, double time = 0.0);
+
+// Maps the file and creates its bodies in `registry` in bulk, copying each component
+// section straight from the mapping. Returns the first root body, like
+// createSolarSystem, or entt::null if the file is missing, truncated or from an
+// incompatible build.
+entt::entity loadCheckpoint(entt::registry &registry, const std::string &path, double *time = nullptr);
+
+} // namespace sfs::model
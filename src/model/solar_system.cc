@@ -45,7 +45,7 @@ entt::entity createBodyFromJPL(entt::registry &registry,
 
 } // namespace
 
-void createSolarSystem(entt::registry &registry) {
+entt::entity createSolarSystem(entt::registry &registry) {
     // Data from January 1, 2025, 00:00 UTC
     auto sun = createBodyFromJPL(
         registry,
@@ -132,33 +132,39 @@ void createSolarSystem(entt::registry &registry) {
         sun
     );
 
-    // Create asteroids
-    // std::default_random_engine generator;
-    // std::uniform_real_distribution<double> distanceDistribution(300.0e9, 500.0e9);
-    // std::uniform_real_distribution<double> speedDistribution(15000.0, 25000.0);
-    // std::uniform_real_distribution<double> angleDistribution(0.0, 2.0 * M_PI);
-    // std::uniform_real_distribution<double> massDistribution(1.0e15, 1.0e20);
-    // for (int i = 0; i < 100; i++) {
-    //     double distance = distanceDistribution(generator);
-    //     double speed = speedDistribution(generator);
-    //     double angle = angleDistribution(generator);
-    //     double mass = massDistribution(generator);
-    //
-    //     Eigen::Vector3d position(distance * cos(angle), 0, distance * sin(angle));
-    //     Eigen::Vector3d velocity(-speed * sin(angle), 0, speed * cos(angle));
-    //
-    //     auto asteroid = registry.create();
-    //     registry.emplace<BodyState>(asteroid, sun, position, velocity);
-    //     registry.emplace<Body>(asteroid, mass);
-    //     registry.emplace<RenderDot>(asteroid, 0.007f);
-    //     // registry.emplace<RenderTrajectory>(asteroid);
-    // }
-
     for (auto entity : registry.view<physics::BodyState>()) {
         if (entity != sun) registry.emplace<physics::KeplerParameters>(entity);
         registry.emplace<physics::ForceAccumulator>(entity);
     }
 
+    physics::recalculateAllKeplerParameters(registry);
+    return sun;
+}
+
+void createAsteroidBelt(entt::registry &registry, entt::entity primary, int count, unsigned int seed, bool testParticles) {
+    std::default_random_engine generator(seed);
+    std::uniform_real_distribution<double> distanceDistribution(300.0e9, 500.0e9);
+    std::uniform_real_distribution<double> speedDistribution(15000.0, 25000.0);
+    std::uniform_real_distribution<double> angleDistribution(0.0, 2.0 * M_PI);
+    std::uniform_real_distribution<double> massDistribution(1.0e15, 1.0e20);
+    for (int i = 0; i < count; i++) {
+        double distance = distanceDistribution(generator);
+        double speed = speedDistribution(generator);
+        double angle = angleDistribution(generator);
+        double mass = massDistribution(generator);
+
+        Eigen::Vector3d position(distance * cos(angle), 0, distance * sin(angle));
+        Eigen::Vector3d velocity(-speed * sin(angle), 0, speed * cos(angle));
+
+        auto asteroid = registry.create();
+        registry.emplace<physics::BodyState>(asteroid, primary, position, velocity);
+        registry.emplace<physics::Body>(asteroid, mass);
+        registry.emplace<physics::KeplerParameters>(asteroid);
+        registry.emplace<physics::ForceAccumulator>(asteroid, Eigen::Vector3d::Zero());
+        registry.emplace<render::RenderDot>(asteroid, 0.007f);
+        if (testParticles) registry.emplace<physics::TestParticle>(asteroid);
+    }
+
     physics::recalculateAllKeplerParameters(registry);
 }
 
@@ -4,6 +4,11 @@
 
 namespace sfs::model {
 
-void createSolarSystem(entt::registry &registry);
+// Returns the Sun, the root of the body hierarchy
+entt::entity createSolarSystem(entt::registry &registry);
+
+// Adds `count` asteroids orbiting `primary` between 300 and 500 million km, as test
+// particles if `testParticles` is set
+void createAsteroidBelt(entt::registry &registry, entt::entity primary, int count, unsigned int seed = 0, bool testParticles = false);
 
 } // namespace sfs::model
@@ -0,0 +1,194 @@
+#include "barnes_hut.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "physics/body_arrays.h"
+#include "physics/parallel.h"
+
+namespace sfs::physics {
+
+namespace {
+
+constexpr uint32_t kLeafSize = 8;
+constexpr int kMaxDepth = 32;  // Stops subdividing coincident bodies
+constexpr double kCutoffSquared = 1e12;  // (1000 km)^2
+
+int octantOf(const BarnesHutNode &node, double x, double y, double z) {
+    return (x >= node.cx ? 1 : 0) | (y >= node.cy ? 2 : 0) | (z >= node.cz ? 4 : 0);
+}
+
+void buildNode(const BodyArrays &bodies, BarnesHutTree &tree, uint32_t nodeIndex, int depth) {
+    // NB: `tree.nodes` may reallocate while children are added, so nodes are always
+    // accessed through their index
+    {
+        auto &node = tree.nodes[nodeIndex];
+        double mass = 0.0, mx = 0.0, my = 0.0, mz = 0.0;
+        for (uint32_t k = node.begin; k < node.end; k++) {
+            int32_t i = tree.order[k];
+            mass += bodies.m[i];
+            mx += bodies.m[i] * bodies.ax[i];
+            my += bodies.m[i] * bodies.ay[i];
+            mz += bodies.m[i] * bodies.az[i];
+        }
+        node.mass = mass;
+        if (mass > 0.0) {
+            node.mx = mx / mass, node.my = my / mass, node.mz = mz / mass;
+        } else {
+            node.mx = node.cx, node.my = node.cy, node.mz = node.cz;
+        }
+        if (node.end - node.begin <= kLeafSize || depth >= kMaxDepth) return;
+    }
+
+    // Counting sort of the node's bodies by octant
+    BarnesHutNode parent = tree.nodes[nodeIndex];
+    uint32_t counts[8] = { };
+    for (uint32_t k = parent.begin; k < parent.end; k++) {
+        int32_t i = tree.order[k];
+        counts[octantOf(parent, bodies.ax[i], bodies.ay[i], bodies.az[i])]++;
+    }
+    uint32_t starts[8];
+    uint32_t offset = parent.begin;
+    for (int o = 0; o < 8; o++) {
+        starts[o] = offset;
+        offset += counts[o];
+    }
+    uint32_t cursor[8];
+    std::copy(starts, starts + 8, cursor);
+    for (uint32_t k = parent.begin; k < parent.end; k++) {
+        int32_t i = tree.order[k];
+        tree.scratch[cursor[octantOf(parent, bodies.ax[i], bodies.ay[i], bodies.az[i])]++] = i;
+    }
+    std::copy(tree.scratch.begin() + parent.begin, tree.scratch.begin() + parent.end, tree.order.begin() + parent.begin);
+
+    auto firstChild = static_cast<uint32_t>(tree.nodes.size());
+    uint32_t childCount = 0;
+    double quarter = 0.5 * parent.halfSize;
+    for (int o = 0; o < 8; o++) {
+        if (counts[o] == 0) continue;
+        BarnesHutNode child{ };
+        child.cx = parent.cx + (o & 1 ? quarter : -quarter);
+        child.cy = parent.cy + (o & 2 ? quarter : -quarter);
+        child.cz = parent.cz + (o & 4 ? quarter : -quarter);
+        child.halfSize = quarter;
+        child.begin = starts[o];
+        child.end = starts[o] + counts[o];
+        tree.nodes.push_back(child);
+        childCount++;
+    }
+    tree.nodes[nodeIndex].firstChild = firstChild;
+    tree.nodes[nodeIndex].childCount = childCount;
+    for (uint32_t c = 0; c < childCount; c++) buildNode(bodies, tree, firstChild + c, depth + 1);
+}
+
+bool containsPoint(const BarnesHutNode &node, double x, double y, double z) {
+    return std::fabs(x - node.cx) <= node.halfSize && std::fabs(y - node.cy) <= node.halfSize && std::fabs(z - node.cz) <= node.halfSize;
+}
+
+bool isExcluded(const BodyArrays &bodies, size_t i, int32_t j) {
+    for (uint32_t k = bodies.excludedOffset[i]; k < bodies.excludedOffset[i + 1]; k++) {
+        if (bodies.excluded[k] == j) return true;
+    }
+    return false;
+}
+
+} // namespace
+
+void buildBarnesHutTree(const BodyArrays &bodies, BarnesHutTree &tree) {
+    tree.nodes.clear();
+    tree.order.clear();
+    tree.primaries.clear();
+
+    auto &isPrimary = tree.isPrimary;
+    isPrimary.assign(bodies.size(), 0);
+    for (size_t i = 0; i < bodies.size(); i++) {
+        if (bodies.primary[i] >= 0) isPrimary[bodies.primary[i]] = 1;
+    }
+
+    double minX = INFINITY, minY = INFINITY, minZ = INFINITY;
+    double maxX = -INFINITY, maxY = -INFINITY, maxZ = -INFINITY;
+    for (size_t i = 0; i < bodies.size(); i++) {
+        if (isPrimary[i]) {
+            tree.primaries.push_back(static_cast<int32_t>(i));
+            continue;
+        }
+        tree.order.push_back(static_cast<int32_t>(i));
+        minX = std::min(minX, bodies.ax[i]), maxX = std::max(maxX, bodies.ax[i]);
+        minY = std::min(minY, bodies.ay[i]), maxY = std::max(maxY, bodies.ay[i]);
+        minZ = std::min(minZ, bodies.az[i]), maxZ = std::max(maxZ, bodies.az[i]);
+    }
+    if (tree.order.empty()) return;
+
+    BarnesHutNode root{ };
+    root.cx = 0.5 * (minX + maxX), root.cy = 0.5 * (minY + maxY), root.cz = 0.5 * (minZ + maxZ);
+    root.halfSize = 0.5 * std::max({ maxX - minX, maxY - minY, maxZ - minZ }) * (1.0 + 1e-9) + 1.0;
+    root.begin = 0;
+    root.end = static_cast<uint32_t>(tree.order.size());
+    tree.nodes.push_back(root);
+    tree.scratch.resize(tree.order.size());
+    buildNode(bodies, tree, 0, 0);
+}
+
+void accumulateBarnesHutGravity(BodyArrays &bodies, const BarnesHutTree &tree, double theta, ThreadPool *pool,
+                                const std::vector<uint32_t> *targets) {
+    double theta2 = theta * theta;
+    // Each body only writes its own accelerations
+    parallelFor(pool, 0, targets ? targets->size() : bodies.size(), 64, [&](size_t first, size_t last) {
+        std::vector<uint32_t> stack;
+        for (size_t t = first; t < last; t++) {
+            size_t i = targets ? (*targets)[t] : t;
+            if (!bodies.hasForce[i]) continue;
+            double px = bodies.ax[i], py = bodies.ay[i], pz = bodies.az[i];
+            double gx = 0.0, gy = 0.0, gz = 0.0;
+
+            // Primaries are summed exactly, honoring the ancestor exclusion
+            for (int32_t j : tree.primaries) {
+                if (isExcluded(bodies, i, j)) continue;
+                double rx = bodies.ax[j] - px, ry = bodies.ay[j] - py, rz = bodies.az[j] - pz;
+                double r2 = rx * rx + ry * ry + rz * rz;
+                if (r2 < kCutoffSquared) continue;
+                double s = bodies.m[j] / (r2 * std::sqrt(r2));
+                gx += s * rx, gy += s * ry, gz += s * rz;
+            }
+
+            if (!tree.nodes.empty()) stack.push_back(0);
+            while (!stack.empty()) {
+                const auto &node = tree.nodes[stack.back()];
+                stack.pop_back();
+
+                double rx = node.mx - px, ry = node.my - py, rz = node.mz - pz;
+                double r2 = rx * rx + ry * ry + rz * rz;
+                double size = 2.0 * node.halfSize;
+                // Cells containing the body are always opened so that it never feels itself
+                if (node.firstChild != 0 && (size * size >= theta2 * r2 || containsPoint(node, px, py, pz))) {
+                    for (uint32_t c = 0; c < node.childCount; c++) stack.push_back(node.firstChild + c);
+                    continue;
+                }
+
+                if (node.firstChild == 0 && (size * size >= theta2 * r2 || containsPoint(node, px, py, pz))) {
+                    for (uint32_t k = node.begin; k < node.end; k++) {
+                        int32_t j = tree.order[k];
+                        if (static_cast<size_t>(j) == i) continue;
+                        double bx = bodies.ax[j] - px, by = bodies.ay[j] - py, bz = bodies.az[j] - pz;
+                        double b2 = bx * bx + by * by + bz * bz;
+                        if (b2 < kCutoffSquared) continue;
+                        double s = bodies.m[j] / (b2 * std::sqrt(b2));
+                        gx += s * bx, gy += s * by, gz += s * bz;
+                    }
+                    continue;
+                }
+
+                // Far enough away to be treated as a point mass
+                if (r2 < kCutoffSquared) continue;
+                double s = node.mass / (r2 * std::sqrt(r2));
+                gx += s * rx, gy += s * ry, gz += s * rz;
+            }
+
+            bodies.gx[i] += gx;
+            bodies.gy[i] += gy;
+            bodies.gz[i] += gz;
+        }
+    });
+}
+
+} // namespace sfs::physics
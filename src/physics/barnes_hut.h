@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace sfs::physics {
+
+struct BodyArrays;
+class ThreadPool;
+
+struct BarnesHutNode {
+    double cx, cy, cz;  // Geometric center of the cube
+    double halfSize;
+    double mx, my, mz;  // Center of mass
+    double mass;
+    uint32_t firstChild;  // Children are stored contiguously; 0 for leaves
+    uint32_t childCount;
+    uint32_t begin, end;  // Range of bodies in BarnesHutTree::order
+};
+
+// Octree over every body that is not a primary. Rebuilt each step; the buffers are
+// kept around so that rebuilding does not allocate.
+struct BarnesHutTree {
+    std::vector<BarnesHutNode> nodes;
+    std::vector<int32_t> order;      // Body indices, grouped by leaf
+    std::vector<int32_t> primaries;  // Bodies with satellites, summed directly
+    std::vector<int32_t> scratch;
+    std::vector<uint8_t> isPrimary;  // Per body, while building
+};
+
+void buildBarnesHutTree(const BodyArrays &bodies, BarnesHutTree &tree);
+
+// Accumulates gravitational accelerations, without the G factor, into gx/gy/gz using
+// the tree for non-primary sources and a direct sum for primaries. Primaries are never
+// approximated, since a body must not feel its own ancestors and the exclusion has to
+// be exact. `theta` is the opening angle; 0 degenerates into the direct sum. Targets
+// are split across `pool` if given. Only the bodies in `targets` are evaluated, if not
+// null, though every body still acts as a source.
+//
+// NB: Reads the absolute position cache, which must be up to date
+// NB: Caller must clear gx/gy/gz of the targets before calling
+void accumulateBarnesHutGravity(BodyArrays &bodies, const BarnesHutTree &tree, double theta, ThreadPool *pool = nullptr,
+                                const std::vector<uint32_t> *targets = nullptr);
+
+} // namespace sfs::physics
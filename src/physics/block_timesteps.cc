@@ -0,0 +1,64 @@
+#include "block_timesteps.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "physics/body_arrays.h"
+#include "physics/physics.h"
+
+namespace sfs::physics {
+
+namespace {
+
+// Longest step body i may take, or infinity if nothing limits it
+double allowedTimestep(const BodyArrays &bodies, size_t i, double stepsPerOrbit) {
+    int32_t primary = bodies.primary[i];
+    if (primary < 0) return INFINITY;
+
+    double mu = kGravitationalConstant * bodies.m[primary];
+    double r2 = bodies.x[i] * bodies.x[i] + bodies.y[i] * bodies.y[i] + bodies.z[i] * bodies.z[i];
+    double v2 = bodies.vx[i] * bodies.vx[i] + bodies.vy[i] * bodies.vy[i] + bodies.vz[i] * bodies.vz[i];
+    double r = std::sqrt(r2);
+    if (mu <= 0.0 || r == 0.0) return INFINITY;
+
+    double alpha = 2.0 / r - v2 / mu;
+    double period = alpha > 0.0 ? 2.0 * M_PI / (std::sqrt(mu) * alpha * std::sqrt(alpha)) : 2.0 * M_PI * r / std::sqrt(v2);
+    double allowed = period / stepsPerOrbit;
+
+    if (bodies.hasForce[i] && bodies.m[i] > 0.0) {
+        double f2 = bodies.fx[i] * bodies.fx[i] + bodies.fy[i] * bodies.fy[i] + bodies.fz[i] * bodies.fz[i];
+        double ratio = std::sqrt(f2) / bodies.m[i] / (mu / r2);
+        if (ratio > 1.0) allowed /= std::sqrt(ratio);
+    }
+    return allowed;
+}
+
+} // namespace
+
+int assignTimestepLevels(BodyArrays &bodies, double dt, int maxLevel, double stepsPerOrbit) {
+    size_t n = bodies.size();
+    for (size_t i = 0; i < n; i++) {
+        double ratio = std::fabs(dt) / allowedTimestep(bodies, i, stepsPerOrbit);
+        int level = ratio > 1.0 ? static_cast<int>(std::ceil(std::log2(ratio))) : 0;
+        bodies.timestepLevel[i] = static_cast<uint8_t>(std::clamp(level, 0, maxLevel));
+    }
+
+    // Satellites come after their primaries, so a backward pass reaches whole subtrees
+    int deepest = 0;
+    for (size_t i = n; i-- > 0;) {
+        int32_t primary = bodies.primary[i];
+        if (primary >= 0) bodies.timestepLevel[primary] = std::max(bodies.timestepLevel[primary], bodies.timestepLevel[i]);
+        deepest = std::max<int>(deepest, bodies.timestepLevel[i]);
+    }
+    return deepest;
+}
+
+void collectActiveBodies(const BodyArrays &bodies, int deepestLevel, size_t subStep, std::vector<uint32_t> &active) {
+    active.clear();
+    for (size_t i = 0; i < bodies.size(); i++) {
+        size_t stride = size_t{ 1 } << (deepestLevel - bodies.timestepLevel[i]);
+        if (subStep % stride == 0) active.push_back(static_cast<uint32_t>(i));
+    }
+}
+
+} // namespace sfs::physics
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace sfs::physics {
+
+struct BodyArrays;
+
+// Assigns every body a timestep level k, meaning it is kicked every dt / 2^k, and
+// returns the deepest level in use. A body orbiting a primary aims for
+// `stepsPerOrbit` kicks per orbital period, and more when its perturbing acceleration
+// (the last force over its mass) exceeds the pull of its primary: since the kick error
+// grows with the square of the step, the step shrinks with the square root of that
+// ratio. Unbound bodies use 2 pi r / v in place of the period. A primary is never
+// stepped more coarsely than its satellites, since their pull on it varies on their
+// timescale; root bodies without satellites stay at level 0.
+//
+// NB: Reads the relative states and the forces of the last evaluation
+int assignTimestepLevels(BodyArrays &bodies, double dt, int maxLevel, double stepsPerOrbit);
+
+// Collects the bodies due for a kick at sub-step `subStep` of the 2^`deepestLevel`
+// sub-steps in a base step. Every body is active at sub-step 0.
+void collectActiveBodies(const BodyArrays &bodies, int deepestLevel, size_t subStep, std::vector<uint32_t> &active);
+
+} // namespace sfs::physics
@@ -0,0 +1,202 @@
+#include "body_arrays.h"
+
+#include <algorithm>
+#include <tuple>
+
+#include "physics/physics.h"
+
+namespace sfs::physics {
+
+namespace {
+
+int depthOf(entt::registry &registry, entt::entity entity) {
+    int depth = 0;
+    for (auto cur = registry.get<BodyState>(entity).st.primary; cur != entt::null; cur = registry.get<BodyState>(cur).st.primary) {
+        depth++;
+    }
+    return depth;
+}
+
+bool layoutMatches(entt::registry &registry, const BodyArrays &bodies, size_t count) {
+    if (bodies.size() != count) return false;
+    for (size_t i = 0; i < bodies.size(); i++) {
+        auto entity = bodies.entity[i];
+        if (!registry.valid(entity) || !registry.all_of<BodyState, Body>(entity) || registry.all_of<TestParticle>(entity)) return false;
+
+        auto primary = registry.get<BodyState>(entity).st.primary;
+        entt::entity expected = bodies.primary[i] < 0 ? entt::entity(entt::null) : bodies.entity[bodies.primary[i]];
+        if (primary != expected) return false;
+        if (bodies.hasForce[i] != registry.all_of<ForceAccumulator>(entity)) return false;
+        if (bodies.hasKepler[i] != registry.all_of<KeplerParameters>(entity)) return false;
+        if (bodies.hasKepler[i] && !registry.all_of<KeplerSolverState>(entity)) return false;
+    }
+    return true;
+}
+
+void rebuildLayout(entt::registry &registry, BodyArrays &bodies) {
+    struct Key {
+        int depth;
+        uint32_t primary;
+        uint32_t entity;
+        entt::entity handle;
+    };
+
+    std::vector<Key> keys;
+    auto view = registry.view<BodyState, Body>(entt::exclude<TestParticle>);
+    for (auto entity : view) {
+        auto primary = view.get<BodyState>(entity).st.primary;
+        uint32_t primaryId = primary == entt::null ? 0 : static_cast<uint32_t>(entt::to_entity(primary));
+        keys.push_back(Key{ depthOf(registry, entity), primaryId, static_cast<uint32_t>(entt::to_entity(entity)), entity });
+    }
+    std::sort(keys.begin(), keys.end(), [](const Key &a, const Key &b) {
+        return std::tie(a.depth, a.primary, a.entity) < std::tie(b.depth, b.primary, b.entity);
+    });
+
+    bodies.resize(keys.size());
+    bodies.mappedCorrectorOrder = 0;
+    bodies.indexOf.clear();
+    for (size_t i = 0; i < keys.size(); i++) {
+        auto id = entt::to_entity(keys[i].handle);
+        if (bodies.indexOf.size() <= id) bodies.indexOf.resize(id + 1, -1);
+        bodies.indexOf[id] = static_cast<int32_t>(i);
+        bodies.entity[i] = keys[i].handle;
+        bodies.hasForce[i] = registry.all_of<ForceAccumulator>(keys[i].handle);
+        bodies.hasKepler[i] = registry.all_of<KeplerParameters>(keys[i].handle);
+        bodies.perturbed[i] = 1;
+        // Every Kepler-propagated body carries its last solution
+        if (bodies.hasKepler[i]) registry.get_or_emplace<KeplerSolverState>(keys[i].handle);
+    }
+    for (size_t i = 0; i < keys.size(); i++) {
+        auto primary = registry.get<BodyState>(keys[i].handle).st.primary;
+        bodies.primary[i] = primary == entt::null ? -1 : bodies.indexOf[entt::to_entity(primary)];
+    }
+
+    // Walking up the chain yields decreasing indices, so each set is written back to front
+    bodies.excludedOffset.assign(keys.size() + 1, 0);
+    bodies.excluded.clear();
+    for (size_t i = 0; i < keys.size(); i++) {
+        size_t begin = bodies.excluded.size();
+        for (int32_t cur = static_cast<int32_t>(i); cur >= 0; cur = bodies.primary[cur]) bodies.excluded.push_back(cur);
+        std::reverse(bodies.excluded.begin() + begin, bodies.excluded.end());
+        bodies.excludedOffset[i + 1] = static_cast<uint32_t>(bodies.excluded.size());
+    }
+}
+
+bool correctedStatesMatch(entt::registry &registry, const BodyArrays &bodies) {
+    for (size_t i = 0; i < bodies.size(); i++) {
+        const auto &state = registry.get<BodyState>(bodies.entity[i]);
+        if (state.st.pos != Eigen::Vector3d(bodies.ox[i], bodies.oy[i], bodies.oz[i]) ||
+            state.st.vel != Eigen::Vector3d(bodies.ovx[i], bodies.ovy[i], bodies.ovz[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+void BodyArrays::resize(size_t n) {
+    entity.resize(n);
+    primary.resize(n);
+    x.resize(n), y.resize(n), z.resize(n);
+    vx.resize(n), vy.resize(n), vz.resize(n);
+    m.resize(n);
+    fx.resize(n), fy.resize(n), fz.resize(n);
+    gx.resize(n), gy.resize(n), gz.resize(n);
+    potential.resize(n);
+    hasForce.resize(n);
+    hasKepler.resize(n);
+    kepler.resize(n);
+    solver.resize(n);
+    perturbed.resize(n);
+    timestepLevel.resize(n);
+    ax.resize(n), ay.resize(n), az.resize(n);
+    avx.resize(n), avy.resize(n), avz.resize(n);
+    ox.resize(n), oy.resize(n), oz.resize(n);
+    ovx.resize(n), ovy.resize(n), ovz.resize(n);
+}
+
+BodyArrays &gatherBodyArrays(entt::registry &registry) {
+    auto &bodies = registry.ctx().emplace<BodyArrays>();
+
+    size_t count = 0;
+    for (auto entity : registry.view<BodyState, Body>(entt::exclude<TestParticle>)) {
+        (void) entity;
+        count++;
+    }
+    if (!layoutMatches(registry, bodies, count)) rebuildLayout(registry, bodies);
+
+    // An edit to any body drops the whole mapping, since the mapped states of the others
+    // were derived from the old corrected states
+    bool wasMapped = bodies.mappedCorrectorOrder != 0;
+    if (wasMapped && !correctedStatesMatch(registry, bodies)) bodies.mappedCorrectorOrder = 0;
+
+    for (size_t i = 0; i < bodies.size(); i++) {
+        auto entity = bodies.entity[i];
+        if (bodies.mappedCorrectorOrder == 0) {
+            const auto &state = registry.get<BodyState>(entity);
+            // The arrays still hold what the last step scattered, so any difference was
+            // written by someone else
+            if (wasMapped || state.st.pos != Eigen::Vector3d(bodies.x[i], bodies.y[i], bodies.z[i]) ||
+                state.st.vel != Eigen::Vector3d(bodies.vx[i], bodies.vy[i], bodies.vz[i])) {
+                bodies.perturbed[i] = 1;
+            }
+            bodies.x[i] = state.st.pos.x(), bodies.y[i] = state.st.pos.y(), bodies.z[i] = state.st.pos.z();
+            bodies.vx[i] = state.st.vel.x(), bodies.vy[i] = state.st.vel.y(), bodies.vz[i] = state.st.vel.z();
+        }
+        bodies.m[i] = registry.get<Body>(entity).mass;
+
+        if (bodies.hasForce[i]) {
+            const auto &force = registry.get<ForceAccumulator>(entity).force;
+            bodies.fx[i] = force.x(), bodies.fy[i] = force.y(), bodies.fz[i] = force.z();
+        } else {
+            bodies.fx[i] = bodies.fy[i] = bodies.fz[i] = 0.0;
+        }
+        if (bodies.hasKepler[i]) {
+            bodies.kepler[i] = registry.get<KeplerParameters>(entity);
+            bodies.solver[i] = registry.get<KeplerSolverState>(entity);
+        }
+    }
+    calculateAbsoluteStates(bodies);
+    return bodies;
+}
+
+const BodyArrays &getBodyArrays(entt::registry &registry) {
+    if (auto *bodies = registry.ctx().find<BodyArrays>()) return *bodies;
+    return gatherBodyArrays(registry);
+}
+
+void calculateAbsoluteStates(BodyArrays &bodies) {
+    for (size_t i = 0; i < bodies.size(); i++) {
+        int32_t p = bodies.primary[i];
+        if (p < 0) {
+            bodies.ax[i] = bodies.x[i], bodies.ay[i] = bodies.y[i], bodies.az[i] = bodies.z[i];
+            bodies.avx[i] = bodies.vx[i], bodies.avy[i] = bodies.vy[i], bodies.avz[i] = bodies.vz[i];
+        } else {
+            bodies.ax[i] = bodies.ax[p] + bodies.x[i], bodies.ay[i] = bodies.ay[p] + bodies.y[i], bodies.az[i] = bodies.az[p] + bodies.z[i];
+            bodies.avx[i] = bodies.avx[p] + bodies.vx[i], bodies.avy[i] = bodies.avy[p] + bodies.vy[i], bodies.avz[i] = bodies.avz[p] + bodies.vz[i];
+        }
+    }
+}
+
+void scatterBodyArrays(entt::registry &registry, const BodyArrays &bodies) {
+    for (size_t i = 0; i < bodies.size(); i++) {
+        auto entity = bodies.entity[i];
+        auto &state = registry.get<BodyState>(entity);
+        if (bodies.mappedCorrectorOrder != 0) {
+            state.st.pos = Eigen::Vector3d(bodies.ox[i], bodies.oy[i], bodies.oz[i]);
+            state.st.vel = Eigen::Vector3d(bodies.ovx[i], bodies.ovy[i], bodies.ovz[i]);
+        } else {
+            state.st.pos = Eigen::Vector3d(bodies.x[i], bodies.y[i], bodies.z[i]);
+            state.st.vel = Eigen::Vector3d(bodies.vx[i], bodies.vy[i], bodies.vz[i]);
+        }
+
+        if (bodies.hasForce[i]) registry.get<ForceAccumulator>(entity).force = Eigen::Vector3d(bodies.fx[i], bodies.fy[i], bodies.fz[i]);
+        if (bodies.hasKepler[i]) {
+            registry.get<KeplerParameters>(entity) = bodies.kepler[i];
+            registry.get<KeplerSolverState>(entity) = bodies.solver[i];
+        }
+    }
+}
+
+} // namespace sfs::physics
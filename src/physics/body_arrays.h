@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <entt/entt.hpp>
+
+#include "physics/kepler.h"
+
+namespace sfs::physics {
+
+// Packed structure-of-arrays mirror of every entity with BodyState and Body, except test
+// particles, so that the force and drift loops run over contiguous memory instead of
+// entt pools.
+//
+// Bodies are ordered by depth in the hierarchy, with bodies orbiting the same primary
+// next to each other. Primaries therefore always come before their satellites, so
+// absolute states can be filled in a single forward pass.
+//
+// The registry stays the source of truth between steps: the arrays are gathered at the
+// start of physicsUpdate and scattered back at the end.
+struct BodyArrays {
+    std::vector<entt::entity> entity;
+    std::vector<int32_t> primary;   // Index of the primary body, or -1 for root bodies
+
+    // State relative to the primary, same as PhysicsState
+    std::vector<double> x, y, z;
+    std::vector<double> vx, vy, vz;
+    std::vector<double> m;
+    std::vector<double> fx, fy, fz;
+    std::vector<double> gx, gy, gz;  // Gravity kernel scratch, acceleration divided by G
+    // Body j's share of the potential energy divided by -G, m_j sum(m_i / r_ij) over the
+    // i < j it was paired with, when a DiagnosticsCapture asks for it
+    std::vector<double> potential;
+
+    std::vector<uint8_t> hasForce;   // Entity has a ForceAccumulator
+    std::vector<uint8_t> hasKepler;  // Entity has KeplerParameters
+    std::vector<KeplerParameters> kepler;
+    std::vector<KeplerSolverState> solver;  // Valid where hasKepler
+    // Relative state changed by something other than Kepler propagation since the
+    // Kepler parameters were computed: a kick, an edit of the registry, or a rebuild
+    std::vector<uint8_t> perturbed;
+    // Block timestep level and the bodies due at the current sub-step, when block
+    // timesteps are enabled
+    std::vector<uint8_t> timestepLevel;
+    std::vector<uint32_t> active;
+
+    // Absolute state cache, valid after a gather or a physics step
+    std::vector<double> ax, ay, az;
+    std::vector<double> avx, avy, avz;
+
+    // With a symplectic corrector on, x..vz hold the integrator's mapped states between
+    // steps, and the corrected states written to the registry are kept here so that a
+    // gather can tell them from edits. `mappedCorrectorOrder` is 0 when x..vz are real
+    // states, and `mappedStep` the dt the mapping was made for.
+    std::vector<double> ox, oy, oz;
+    std::vector<double> ovx, ovy, ovz;
+    int mappedCorrectorOrder = 0;
+    double mappedStep = 0.0;
+
+    // Gravity exclusion sets in CSR form: body i must ignore the bodies
+    // excluded[excludedOffset[i] .. excludedOffset[i + 1]), which are its ancestors and
+    // itself in increasing index order.
+    std::vector<uint32_t> excludedOffset;
+    std::vector<int32_t> excluded;
+
+    // Maps entt::to_entity(entity) to its index in the arrays, or -1
+    std::vector<int32_t> indexOf;
+
+    size_t size() const { return entity.size(); }
+    void resize(size_t n);
+};
+
+// Copies the registry state into the registry's BodyArrays context variable, rebuilding
+// the body ordering if bodies or primaries changed since the last gather, and fills the
+// absolute state cache. Mapped states are kept while the registry still holds the
+// corrected states they were scattered as, and dropped otherwise.
+BodyArrays &gatherBodyArrays(entt::registry &registry);
+
+// Returns the arrays as of the last gather or physics step, gathering them if the
+// registry has none yet. Render systems and diagnostics read absolute states from here.
+const BodyArrays &getBodyArrays(entt::registry &registry);
+
+// Refills the absolute state cache from the relative states
+void calculateAbsoluteStates(BodyArrays &bodies);
+
+inline Eigen::Vector3d absolutePosition(const BodyArrays &bodies, entt::entity entity) {
+    int32_t i = bodies.indexOf[entt::to_entity(entity)];
+    return Eigen::Vector3d(bodies.ax[i], bodies.ay[i], bodies.az[i]);
+}
+
+inline Eigen::Vector3d absoluteVelocity(const BodyArrays &bodies, entt::entity entity) {
+    int32_t i = bodies.indexOf[entt::to_entity(entity)];
+    return Eigen::Vector3d(bodies.avx[i], bodies.avy[i], bodies.avz[i]);
+}
+
+// Copies positions, velocities, forces and Kepler parameters back into the registry.
+// Writes the corrected states instead while the arrays hold mapped ones.
+void scatterBodyArrays(entt::registry &registry, const BodyArrays &bodies);
+
+} // namespace sfs::physics
@@ -0,0 +1,128 @@
+#include "diagnostics.h"
+
+#include <cmath>
+#include <utility>
+
+#include "physics/body_arrays.h"
+#include "physics/physics.h"
+
+namespace sfs::physics {
+
+namespace {
+
+ConservedQuantities calculateConservedQuantities(const StateSnapshot &snapshot) {
+    ConservedQuantities q;
+    size_t n = snapshot.m.size();
+
+    double totalMass = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        totalMass += snapshot.m[i];
+        q.com += snapshot.m[i] * Eigen::Vector3d(snapshot.x[i], snapshot.y[i], snapshot.z[i]);
+    }
+    q.com /= totalMass;
+
+    double potential = snapshot.potential;
+    for (size_t i = 0; i < n; i++) {
+        Eigen::Vector3d pos(snapshot.x[i], snapshot.y[i], snapshot.z[i]);
+        Eigen::Vector3d vel(snapshot.vx[i], snapshot.vy[i], snapshot.vz[i]);
+        q.energy += 0.5 * snapshot.m[i] * vel.squaredNorm();
+        q.momentum += snapshot.m[i] * vel;
+        q.angularMomentum += snapshot.m[i] * pos.cross(vel);
+        if (snapshot.hasPotential) continue;
+
+        double sum = 0.0;
+        for (size_t j = i + 1; j < n; j++) {
+            double rx = snapshot.x[j] - pos.x(), ry = snapshot.y[j] - pos.y(), rz = snapshot.z[j] - pos.z();
+            sum += snapshot.m[j] / std::sqrt(rx * rx + ry * ry + rz * rz);
+        }
+        potential += snapshot.m[i] * sum;
+    }
+    q.energy -= kGravitationalConstant * potential;
+    q.kernelPotential = snapshot.hasPotential;
+    return q;
+}
+
+} // namespace
+
+ConservedQuantityMonitor::ConservedQuantityMonitor(double refreshInterval) : refreshInterval_(refreshInterval) {
+    thread_ = std::thread(&ConservedQuantityMonitor::workerLoop, this);
+}
+
+ConservedQuantityMonitor::~ConservedQuantityMonitor() {
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    thread_.join();
+}
+
+void ConservedQuantityMonitor::update(entt::registry &registry) {
+    auto &capture = registry.ctx().emplace<DiagnosticsCapture>();
+    auto now = Clock::now();
+    if (capture.captured) {
+        capture.captured = false;
+        submit(capture.snapshot);
+        return;
+    }
+    if (now < nextRefresh_ || busy_.load(std::memory_order_acquire)) return;
+    if (!capture.requested) {
+        capture.requested = true;
+        requestedAt_ = now;
+        return;
+    }
+    if (now - requestedAt_ < std::chrono::duration<double>(refreshInterval())) return;
+
+    // No step took the snapshot, so take it here
+    capture.requested = false;
+    const auto &bodies = getBodyArrays(registry);
+    auto &snapshot = capture.snapshot;
+    snapshot.x = bodies.ax, snapshot.y = bodies.ay, snapshot.z = bodies.az;
+    snapshot.vx = bodies.avx, snapshot.vy = bodies.avy, snapshot.vz = bodies.avz;
+    snapshot.m = bodies.m;
+    snapshot.potential = 0.0;
+    snapshot.hasPotential = false;
+    submit(snapshot);
+}
+
+bool ConservedQuantityMonitor::latest(ConservedQuantities &out) const {
+    std::lock_guard lock(mutex_);
+    if (hasResult_) out = result_;
+    return hasResult_;
+}
+
+void ConservedQuantityMonitor::submit(StateSnapshot &snapshot) {
+    nextRefresh_ = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(refreshInterval()));
+    // NB: Only dropped if a capture requested before the panel was last hidden arrives
+    // while the worker is still busy
+    if (busy_.load(std::memory_order_acquire)) return;
+    busy_.store(true, std::memory_order_release);
+    {
+        // Swapping keeps the allocations of both snapshots for the next round
+        std::lock_guard lock(mutex_);
+        std::swap(pendingSnapshot_, snapshot);
+        pending_ = true;
+    }
+    wake_.notify_one();
+}
+
+void ConservedQuantityMonitor::workerLoop() {
+    while (true) {
+        {
+            std::unique_lock lock(mutex_);
+            wake_.wait(lock, [&] { return stop_ || pending_; });
+            if (stop_) return;
+            std::swap(working_, pendingSnapshot_);
+            pending_ = false;
+        }
+        ConservedQuantities q = calculateConservedQuantities(working_);
+        {
+            std::lock_guard lock(mutex_);
+            result_ = q;
+            hasResult_ = true;
+        }
+        busy_.store(false, std::memory_order_release);
+    }
+}
+
+} // namespace sfs::physics
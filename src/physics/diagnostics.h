@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <entt/entt.hpp>
+
+namespace sfs::physics {
+
+// Same quantities as calculateConservedQuantities
+struct ConservedQuantities {
+    Eigen::Vector3d com = Eigen::Vector3d::Zero();
+    double energy = 0.0;
+    Eigen::Vector3d momentum = Eigen::Vector3d::Zero();
+    Eigen::Vector3d angularMomentum = Eigen::Vector3d::Zero();
+    bool kernelPotential = false;  // Potential energy summed by the gravity kernel
+};
+
+// Absolute states and masses of the massive bodies, and their potential energy divided
+// by -G if it is known
+struct StateSnapshot {
+    std::vector<double> x, y, z;
+    std::vector<double> vx, vy, vz;
+    std::vector<double> m;
+    double potential = 0.0;
+    bool hasPotential = false;
+};
+
+// Request for a snapshot, stored in the registry context. While `requested`, the next
+// direct-sum force evaluation of physicsUpdate also sums the potential energy, at one
+// extra multiply-add per pair, and copies the states it saw into `snapshot`. Those are
+// real states at the time of a kick, between the start and the end of the step.
+//
+// NB: Nothing is captured under Barnes-Hut, which only approximates the potential, or
+// with a symplectic corrector, whose kicks see mapped states
+struct DiagnosticsCapture {
+    bool requested = false;
+    bool captured = false;
+    StateSnapshot snapshot;
+};
+
+// Computes conserved quantities on a worker thread, so that the frame loop only ever
+// pays for an O(N) copy, at most once per refresh interval.
+//
+// Each refresh asks physicsUpdate for a DiagnosticsCapture, which comes with the
+// potential energy for free. If no step delivers one within a refresh interval, because
+// the simulation is paused or cannot capture, the absolute state cache is copied
+// instead and the worker sums the potential itself in O(N^2). Results lag the
+// simulation by the refresh interval plus the worker's time.
+class ConservedQuantityMonitor {
+public:
+    explicit ConservedQuantityMonitor(double refreshInterval = 0.5);
+    ~ConservedQuantityMonitor();
+
+    ConservedQuantityMonitor(const ConservedQuantityMonitor &) = delete;
+    ConservedQuantityMonitor &operator=(const ConservedQuantityMonitor &) = delete;
+
+    // Wall-clock seconds between snapshots. Safe to call from any thread.
+    double refreshInterval() const { return refreshInterval_.load(std::memory_order_relaxed); }
+    void setRefreshInterval(double seconds) { refreshInterval_.store(seconds, std::memory_order_relaxed); }
+
+    // Requests, collects or hands over a snapshot as due. Call once per frame or step
+    // while the quantities are shown, from the thread that owns the registry; nothing
+    // is computed while it is not called. Never waits for the worker.
+    void update(entt::registry &registry);
+
+    // Latest finished result. Returns false until the first one. Safe to call from any
+    // thread.
+    bool latest(ConservedQuantities &out) const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void submit(StateSnapshot &snapshot);
+    void workerLoop();
+
+    std::atomic<double> refreshInterval_;
+    Clock::time_point nextRefresh_{};
+    Clock::time_point requestedAt_{};
+    std::atomic<bool> busy_{ false };  // A snapshot is handed over and not yet computed
+
+    std::thread thread_;
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stop_ = false;
+    bool pending_ = false;
+    StateSnapshot pendingSnapshot_;
+    StateSnapshot working_;  // Only touched by the worker
+    bool hasResult_ = false;
+    ConservedQuantities result_;
+};
+
+} // namespace sfs::physics
@@ -0,0 +1,257 @@
+#include "encounters.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include "physics/body_arrays.h"
+#include "physics/physics.h"
+#include "physics/test_particles.h"
+
+namespace sfs::physics {
+
+namespace {
+
+constexpr size_t kSortBudget = 8;               // Insertion sort shifts per item before falling back to std::sort
+constexpr int kGoldenSectionIterations = 48;    // Narrows the closest approach to about 1e-10 of the step
+constexpr double kInverseGoldenRatio = 0.6180339887498949;
+
+// Detector state, kept in the registry context between steps. Items are the bodies in
+// BodyArrays order, then the test particles in TestParticleArrays order.
+struct EncounterState {
+    bool started = false;
+    double time = 0.0;
+    std::vector<entt::entity> entity;
+    std::vector<Eigen::Vector3d> position, velocity;  // Absolute, at `time`
+
+    // Same for the step being processed, swapped in at the end
+    std::vector<entt::entity> nextEntity;
+    std::vector<Eigen::Vector3d> nextPosition, nextVelocity;
+
+    std::vector<int32_t> previous;  // Index of the item at the last call, or -1
+    std::vector<int32_t> primary;   // Item index of the primary, or -1
+    std::vector<uint8_t> bound;     // On an elliptic orbit about its primary
+    std::vector<double> radius;     // Encounter radius, 0 for none
+    std::vector<Eigen::Vector3d> lower, upper;  // Swept boxes, grown by the radius
+    std::vector<std::pair<double, uint32_t>> order;  // Items with a swept box, by lower x
+    double widestWithout = 0.0;     // Widest box along x of the items without a radius
+    std::vector<uint32_t> active;   // Items with a radius whose box may reach the sweep position
+    std::vector<EncounterEvent> found;
+};
+
+void gatherItems(const BodyArrays &bodies, const TestParticleArrays &particles, double hillRadii, EncounterState &state) {
+    size_t n = bodies.size() + particles.size();
+    state.nextEntity.resize(n);
+    state.nextPosition.resize(n);
+    state.nextVelocity.resize(n);
+    state.primary.resize(n);
+    state.bound.resize(n);
+    state.radius.resize(n);
+
+    for (size_t i = 0; i < bodies.size(); i++) {
+        state.nextEntity[i] = bodies.entity[i];
+        state.nextPosition[i] = Eigen::Vector3d(bodies.ax[i], bodies.ay[i], bodies.az[i]);
+        state.nextVelocity[i] = Eigen::Vector3d(bodies.avx[i], bodies.avy[i], bodies.avz[i]);
+        int32_t p = bodies.primary[i];
+        state.primary[i] = p;
+        state.bound[i] = p >= 0 && bodies.hasKepler[i] && bodies.kepler[i].regime == KeplerRegime::Elliptic;
+        state.radius[i] = 0.0;
+        // NB: Primaries come first, so their position is already in
+        if (p >= 0 && bodies.m[i] > 0.0 && bodies.m[p] > 0.0) {
+            double distance = (state.nextPosition[i] - state.nextPosition[p]).norm();
+            state.radius[i] = hillRadii * distance * std::cbrt(bodies.m[i] / (3.0 * bodies.m[p]));
+        }
+    }
+    for (size_t k = 0; k < particles.size(); k++) {
+        size_t i = bodies.size() + k;
+        state.nextEntity[i] = particles.entity[k];
+        state.nextPosition[i] = Eigen::Vector3d(particles.ax[k], particles.ay[k], particles.az[k]);
+        state.nextVelocity[i] = Eigen::Vector3d(particles.avx[k], particles.avy[k], particles.avz[k]);
+        state.primary[i] = particles.primary[k];
+        state.bound[i] = particles.primary[k] >= 0 && particles.kepler[k].regime == KeplerRegime::Elliptic;
+        state.radius[i] = 0.0;
+    }
+}
+
+// Matches the items to the last call's. Returns true if they are the same, in the same order.
+bool matchPrevious(EncounterState &state) {
+    size_t n = state.nextEntity.size();
+    state.previous.resize(n);
+    if (state.entity == state.nextEntity) {
+        std::iota(state.previous.begin(), state.previous.end(), 0);
+        return true;
+    }
+    std::unordered_map<entt::entity, int32_t> indexOf;
+    for (size_t i = 0; i < state.entity.size(); i++) indexOf.emplace(state.entity[i], static_cast<int32_t>(i));
+    for (size_t i = 0; i < n; i++) {
+        auto it = indexOf.find(state.nextEntity[i]);
+        state.previous[i] = it == indexOf.end() ? -1 : it->second;
+    }
+    return false;
+}
+
+// Boxes each item's Hermite arc by the control points of its Bezier form,
+// p0, p0 + v0 dt / 3, p1 - v1 dt / 3 and p1, which contain the arc
+void sweepBoxes(EncounterState &state, double dt) {
+    size_t n = state.nextEntity.size();
+    state.lower.resize(n);
+    state.upper.resize(n);
+    state.widestWithout = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        int32_t j = state.previous[i];
+        if (j < 0) continue;
+        const Eigen::Vector3d &p0 = state.position[j], &p1 = state.nextPosition[i];
+        Eigen::Vector3d c1 = p0 + state.velocity[j] * (dt / 3.0);
+        Eigen::Vector3d c2 = p1 - state.nextVelocity[i] * (dt / 3.0);
+        Eigen::Vector3d grow = Eigen::Vector3d::Constant(state.radius[i]);
+        state.lower[i] = p0.cwiseMin(c1).cwiseMin(c2).cwiseMin(p1) - grow;
+        state.upper[i] = p0.cwiseMax(c1).cwiseMax(c2).cwiseMax(p1) + grow;
+        if (state.radius[i] == 0.0) state.widestWithout = std::max(state.widestWithout, state.upper[i].x() - state.lower[i].x());
+    }
+}
+
+void sortOrder(EncounterState &state, bool reuseOrder) {
+    // Keys are copied next to the items, since comparing through `lower` would miss the
+    // cache on every comparison
+    auto &order = state.order;
+    if (!reuseOrder) {
+        order.clear();
+        for (size_t i = 0; i < state.nextEntity.size(); i++) {
+            if (state.previous[i] >= 0) order.emplace_back(state.lower[i].x(), static_cast<uint32_t>(i));
+        }
+        std::sort(order.begin(), order.end());
+        return;
+    }
+    for (auto &[key, item] : order) key = state.lower[item].x();
+
+    // The order barely changes between steps of a sparse population, where insertion
+    // sort is linear. Dense ones would shift items past many neighbours each step.
+    size_t shifts = 0, budget = kSortBudget * order.size();
+    for (size_t k = 1; k < order.size(); k++) {
+        auto entry = order[k];
+        size_t m = k;
+        for (; m > 0 && entry < order[m - 1]; m--) order[m] = order[m - 1];
+        order[m] = entry;
+        shifts += k - m;
+        if (shifts > budget) {
+            std::sort(order.begin(), order.end());
+            return;
+        }
+    }
+}
+
+// Closest approach of items a and b over the step, if they stop approaching during it
+void testPair(EncounterState &state, uint32_t a, uint32_t b, double dt) {
+    if ((state.primary[a] == static_cast<int32_t>(b) && state.bound[a]) || (state.primary[b] == static_cast<int32_t>(a) && state.bound[b])) return;
+
+    int32_t pa = state.previous[a], pb = state.previous[b];
+    Eigen::Vector3d r0 = state.position[pa] - state.position[pb];
+    Eigen::Vector3d m0 = (state.velocity[pa] - state.velocity[pb]) * dt;
+    Eigen::Vector3d r1 = state.nextPosition[a] - state.nextPosition[b];
+    Eigen::Vector3d m1 = (state.nextVelocity[a] - state.nextVelocity[b]) * dt;
+    if (r0.dot(m0) >= 0.0 || r1.dot(m1) < 0.0) return;
+
+    // Squared distance along the relative arc, in Bezier form
+    Eigen::Vector3d c1 = r0 + m0 / 3.0, c2 = r1 - m1 / 3.0;
+    auto distanceSquared = [&](double s) {
+        double t = 1.0 - s;
+        return (t * t * t * r0 + 3.0 * t * t * s * c1 + 3.0 * t * s * s * c2 + s * s * s * r1).squaredNorm();
+    };
+    double lo = 0.0, hi = 1.0;
+    double s1 = hi - kInverseGoldenRatio, s2 = lo + kInverseGoldenRatio;
+    double f1 = distanceSquared(s1), f2 = distanceSquared(s2);
+    for (int iteration = 0; iteration < kGoldenSectionIterations; iteration++) {
+        if (f1 < f2) {
+            hi = s2, s2 = s1, f2 = f1;
+            s1 = hi - kInverseGoldenRatio * (hi - lo);
+            f1 = distanceSquared(s1);
+        } else {
+            lo = s1, s1 = s2, f1 = f2;
+            s2 = lo + kInverseGoldenRatio * (hi - lo);
+            f2 = distanceSquared(s2);
+        }
+    }
+    double s = 0.5 * (lo + hi);
+    double distance = std::sqrt(distanceSquared(s));
+
+    uint32_t first = state.radius[a] >= state.radius[b] ? a : b;
+    uint32_t second = first == a ? b : a;
+    if (distance >= state.radius[first]) return;
+    state.found.push_back(EncounterEvent{ state.nextEntity[first], state.nextEntity[second], state.time + s * dt, distance });
+}
+
+bool overlapsAcross(const EncounterState &state, uint32_t a, uint32_t b) {
+    return state.lower[a].y() <= state.upper[b].y() && state.lower[b].y() <= state.upper[a].y() && state.lower[a].z() <= state.upper[b].z() &&
+           state.lower[b].z() <= state.upper[a].z();
+}
+
+// Tests `item` against the active items whose box reaches its lower x, and drops the
+// ones that ended before it
+void testActive(EncounterState &state, uint32_t item, double dt) {
+    auto &active = state.active;
+    double start = state.lower[item].x();
+    for (size_t k = 0; k < active.size();) {
+        uint32_t other = active[k];
+        if (state.upper[other].x() < start) {
+            active[k] = active.back();
+            active.pop_back();
+            continue;
+        }
+        if (overlapsAcross(state, other, item)) testPair(state, other, item, dt);
+        k++;
+    }
+}
+
+} // namespace
+
+size_t detectEncounters(entt::registry &registry, double time, double hillRadii) {
+    auto &state = registry.ctx().emplace<EncounterState>();
+    const auto &bodies = getBodyArrays(registry);
+    const auto &particles = getTestParticleArrays(registry);
+    gatherItems(bodies, particles, hillRadii, state);
+
+    state.found.clear();
+    double dt = time - state.time;
+    if (state.started && dt > 0.0) {
+        bool sameItems = matchPrevious(state);
+        sweepBoxes(state, dt);
+        sortOrder(state, sameItems && state.order.size() == state.nextEntity.size());
+
+        // Only items with a radius are kept active, so test particles never meet each
+        // other. An item with a radius looks back for the items without one that
+        // started before it, which are at most the widest of their boxes away.
+        state.active.clear();
+        const auto &order = state.order;
+        for (size_t k = 0; k < order.size(); k++) {
+            auto [start, item] = order[k];
+            testActive(state, item, dt);
+            if (state.radius[item] == 0.0) continue;
+            for (size_t j = k; j-- > 0 && order[j].first >= start - state.widestWithout;) {
+                uint32_t other = order[j].second;
+                if (state.radius[other] == 0.0 && state.upper[other].x() >= start && overlapsAcross(state, other, item)) testPair(state, other, item, dt);
+            }
+            state.active.push_back(item);
+        }
+    } else {
+        // Nothing to sweep from, so the next call sorts from scratch
+        state.order.clear();
+    }
+
+    state.started = true;
+    state.time = time;
+    state.entity.swap(state.nextEntity);
+    state.position.swap(state.nextPosition);
+    state.velocity.swap(state.nextVelocity);
+
+    std::sort(state.found.begin(), state.found.end(), [](const EncounterEvent &a, const EncounterEvent &b) { return a.time < b.time; });
+    auto &queue = registry.ctx().emplace<EncounterQueue>().events;
+    queue.insert(queue.end(), state.found.begin(), state.found.end());
+    return state.found.size();
+}
+
+} // namespace sfs::physics
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+
+#include <entt/entt.hpp>
+
+namespace sfs::physics {
+
+// Closest approach of two bodies, or of a body and a test particle, within the
+// encounter radius of `first`
+struct EncounterEvent {
+    entt::entity first;   // Body whose encounter radius was entered, the larger one if both were
+    entt::entity second;
+    double time;          // Of closest approach
+    double distance;      // At closest approach, m
+};
+
+// Encounters found by detectEncounters, oldest first, stored in the registry context.
+// Consumers pop the events they have handled.
+struct EncounterQueue {
+    std::deque<EncounterEvent> events;
+};
+
+// Finds the close approaches during the physics step that just ended at `time`, and
+// appends them to the registry's EncounterQueue. The encounter radius of a body is
+// `hillRadii` times its Hill radius about its primary, r (m / 3M)^(1/3); root bodies and
+// test particles have none. A pair is reported in the step where it stops approaching,
+// if its closest approach is within the larger of the two radii. A body on a bound orbit
+// about the other is not an encounter.
+//
+// Each body's path over the step is the cubic Hermite arc through its absolute states at
+// either end, which follows the Kepler arc to fourth order in the step, and is boxed by
+// the control points of its Bezier form. The boxes, grown by the encounter radii, are
+// swept and pruned along x, so that only pairs with overlapping boxes are solved for
+// their closest approach. Test particles are never paired with each other. The order
+// from the last step is insertion sorted while that stays cheap, so the cost is about
+// linear in the number of bodies for sparse populations.
+//
+// Call after every physicsUpdate; the first call only records the states. Returns the
+// number of events added.
+size_t detectEncounters(entt::registry &registry, double time, double hillRadii = 1.0);
+
+} // namespace sfs::physics
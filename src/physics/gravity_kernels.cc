@@ -0,0 +1,369 @@
+#include "gravity_kernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define SFS_X86_KERNELS 1
+#endif
+
+#include "physics/body_arrays.h"
+#include "physics/parallel.h"
+#include "physics/test_particles.h"
+
+namespace sfs::physics {
+
+namespace {
+
+constexpr double kCutoffSquared = 1e12;  // (1000 km)^2
+
+// What feels the pull of a range of bodies: body j itself, or a test particle, which has
+// no mass to pull back with. With Potential kernels, m times the sum of m_i / r over the
+// range is added to `potential`.
+struct Target {
+    double x, y, z;
+    double m;
+    double *gx, *gy, *gz;
+    double *potential = nullptr;
+};
+
+Target bodyTarget(BodyArrays &bodies, size_t j) {
+    return Target{ bodies.ax[j], bodies.ay[j], bodies.az[j], bodies.m[j], &bodies.gx[j], &bodies.gy[j], &bodies.gz[j], &bodies.potential[j] };
+}
+
+// An ancestor still feels the pull of body j, but not the other way around. The pair
+// still counts towards j's potential.
+template<bool Potential>
+void accumulateOneSided(BodyArrays &bodies, size_t j, size_t ancestor) {
+    double rx = bodies.ax[j] - bodies.ax[ancestor];
+    double ry = bodies.ay[j] - bodies.ay[ancestor];
+    double rz = bodies.az[j] - bodies.az[ancestor];
+    double r2 = rx * rx + ry * ry + rz * rz;
+    if (r2 < kCutoffSquared) return;
+
+    double inv = 1.0 / std::sqrt(r2);
+    double s = bodies.m[j] * inv * inv * inv;
+    bodies.gx[ancestor] += s * rx;
+    bodies.gy[ancestor] += s * ry;
+    bodies.gz[ancestor] += s * rz;
+    if constexpr (Potential) bodies.potential[j] += bodies.m[j] * bodies.m[ancestor] * inv;
+}
+
+// Applies the pull of bodies [begin, end) to the target and, if Symmetric, the pull of
+// the target back to them
+template<bool Symmetric, bool Potential = false>
+void accumulateRangeScalar(BodyArrays &bodies, const Target &target, size_t begin, size_t end) {
+    const double *ax = bodies.ax.data(), *ay = bodies.ay.data(), *az = bodies.az.data(), *m = bodies.m.data();
+    double *gx = bodies.gx.data(), *gy = bodies.gy.data(), *gz = bodies.gz.data();
+    double pjx = target.x, pjy = target.y, pjz = target.z, mj = target.m;
+
+    double sx = 0.0, sy = 0.0, sz = 0.0, sp = 0.0;
+    for (size_t i = begin; i < end; i++) {
+        double rx = ax[i] - pjx, ry = ay[i] - pjy, rz = az[i] - pjz;
+        double r2 = rx * rx + ry * ry + rz * rz;
+        double inv3 = r2 < kCutoffSquared ? 0.0 : 1.0 / (r2 * std::sqrt(r2));
+        sx += m[i] * inv3 * rx;
+        sy += m[i] * inv3 * ry;
+        sz += m[i] * inv3 * rz;
+        if constexpr (Potential) sp += r2 < kCutoffSquared ? 0.0 : m[i] / std::sqrt(r2);
+        if constexpr (Symmetric) {
+            gx[i] -= mj * inv3 * rx;
+            gy[i] -= mj * inv3 * ry;
+            gz[i] -= mj * inv3 * rz;
+        }
+    }
+    *target.gx += sx;
+    *target.gy += sy;
+    *target.gz += sz;
+    if constexpr (Potential) *target.potential += mj * sp;
+}
+
+#ifdef SFS_X86_KERNELS
+
+__attribute__((target("avx2,fma"))) double horizontalSum(__m256d v) {
+    __m128d lo = _mm256_castpd256_pd128(v);
+    __m128d hi = _mm256_extractf128_pd(v, 1);
+    lo = _mm_add_pd(lo, hi);
+    return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+}
+
+template<bool Symmetric, bool Potential = false>
+__attribute__((target("avx2,fma"))) void accumulateRangeAvx2(BodyArrays &bodies, const Target &target, size_t begin, size_t end) {
+    const double *ax = bodies.ax.data(), *ay = bodies.ay.data(), *az = bodies.az.data(), *m = bodies.m.data();
+    double *gx = bodies.gx.data(), *gy = bodies.gy.data(), *gz = bodies.gz.data();
+    const __m256d pjx = _mm256_set1_pd(target.x), pjy = _mm256_set1_pd(target.y), pjz = _mm256_set1_pd(target.z);
+    const __m256d mj = _mm256_set1_pd(target.m);
+    const __m256d cutoff = _mm256_set1_pd(kCutoffSquared);
+    // The float estimate overflows past this, and such pulls are negligible anyway
+    const __m256d floatLimit = _mm256_set1_pd(1e38);
+    const __m256d half = _mm256_set1_pd(0.5), threeHalves = _mm256_set1_pd(1.5);
+
+    __m256d sx = _mm256_setzero_pd(), sy = _mm256_setzero_pd(), sz = _mm256_setzero_pd(), sp = _mm256_setzero_pd();
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m256d rx = _mm256_sub_pd(_mm256_loadu_pd(ax + i), pjx);
+        __m256d ry = _mm256_sub_pd(_mm256_loadu_pd(ay + i), pjy);
+        __m256d rz = _mm256_sub_pd(_mm256_loadu_pd(az + i), pjz);
+        __m256d r2 = _mm256_fmadd_pd(rx, rx, _mm256_fmadd_pd(ry, ry, _mm256_mul_pd(rz, rz)));
+
+        // 12-bit single precision estimate, refined to double precision by three
+        // Newton steps
+        __m256d inv = _mm256_cvtps_pd(_mm_rsqrt_ps(_mm256_cvtpd_ps(r2)));
+        __m256d halfR2 = _mm256_mul_pd(half, r2);
+        for (int k = 0; k < 3; k++) {
+            inv = _mm256_mul_pd(inv, _mm256_fnmadd_pd(_mm256_mul_pd(halfR2, inv), inv, threeHalves));
+        }
+        __m256d inv3 = _mm256_mul_pd(_mm256_mul_pd(inv, inv), inv);
+        __m256d valid = _mm256_and_pd(_mm256_cmp_pd(r2, cutoff, _CMP_GE_OQ), _mm256_cmp_pd(r2, floatLimit, _CMP_LT_OQ));
+        inv3 = _mm256_and_pd(inv3, valid);
+
+        __m256d mi = _mm256_loadu_pd(m + i);
+        __m256d si = _mm256_mul_pd(mi, inv3);
+        sx = _mm256_fmadd_pd(si, rx, sx);
+        sy = _mm256_fmadd_pd(si, ry, sy);
+        sz = _mm256_fmadd_pd(si, rz, sz);
+        if constexpr (Potential) sp = _mm256_fmadd_pd(mi, _mm256_and_pd(inv, valid), sp);
+
+        if constexpr (Symmetric) {
+            __m256d sj = _mm256_mul_pd(mj, inv3);
+            _mm256_storeu_pd(gx + i, _mm256_fnmadd_pd(sj, rx, _mm256_loadu_pd(gx + i)));
+            _mm256_storeu_pd(gy + i, _mm256_fnmadd_pd(sj, ry, _mm256_loadu_pd(gy + i)));
+            _mm256_storeu_pd(gz + i, _mm256_fnmadd_pd(sj, rz, _mm256_loadu_pd(gz + i)));
+        }
+    }
+
+    *target.gx += horizontalSum(sx);
+    *target.gy += horizontalSum(sy);
+    *target.gz += horizontalSum(sz);
+    if constexpr (Potential) *target.potential += target.m * horizontalSum(sp);
+    if (i < end) accumulateRangeScalar<Symmetric, Potential>(bodies, target, i, end);
+}
+
+template<bool Symmetric, bool Potential = false>
+__attribute__((target("avx512f"))) void accumulateRangeAvx512(BodyArrays &bodies, const Target &target, size_t begin, size_t end) {
+    const double *ax = bodies.ax.data(), *ay = bodies.ay.data(), *az = bodies.az.data(), *m = bodies.m.data();
+    double *gx = bodies.gx.data(), *gy = bodies.gy.data(), *gz = bodies.gz.data();
+    const __m512d pjx = _mm512_set1_pd(target.x), pjy = _mm512_set1_pd(target.y), pjz = _mm512_set1_pd(target.z);
+    const __m512d mj = _mm512_set1_pd(target.m);
+    const __m512d cutoff = _mm512_set1_pd(kCutoffSquared);
+    const __m512d half = _mm512_set1_pd(0.5), threeHalves = _mm512_set1_pd(1.5);
+
+    __m512d sx = _mm512_setzero_pd(), sy = _mm512_setzero_pd(), sz = _mm512_setzero_pd(), sp = _mm512_setzero_pd();
+    for (size_t i = begin; i < end; i += 8) {
+        // The last iteration masks off lanes past the end of the range
+        __mmask8 lanes = end - i >= 8 ? 0xFF : static_cast<__mmask8>((1u << (end - i)) - 1);
+        __m512d rx = _mm512_sub_pd(_mm512_maskz_loadu_pd(lanes, ax + i), pjx);
+        __m512d ry = _mm512_sub_pd(_mm512_maskz_loadu_pd(lanes, ay + i), pjy);
+        __m512d rz = _mm512_sub_pd(_mm512_maskz_loadu_pd(lanes, az + i), pjz);
+        __m512d r2 = _mm512_fmadd_pd(rx, rx, _mm512_fmadd_pd(ry, ry, _mm512_mul_pd(rz, rz)));
+
+        // 14-bit estimate, refined to double precision by two Newton steps
+        __m512d inv = _mm512_rsqrt14_pd(r2);
+        __m512d halfR2 = _mm512_mul_pd(half, r2);
+        for (int k = 0; k < 2; k++) {
+            inv = _mm512_mul_pd(inv, _mm512_fnmadd_pd(_mm512_mul_pd(halfR2, inv), inv, threeHalves));
+        }
+        __mmask8 valid = _mm512_mask_cmp_pd_mask(lanes, r2, cutoff, _CMP_GE_OQ);
+        __m512d inv3 = _mm512_maskz_mul_pd(valid, _mm512_mul_pd(inv, inv), inv);
+
+        __m512d mi = _mm512_maskz_loadu_pd(lanes, m + i);
+        __m512d si = _mm512_mul_pd(mi, inv3);
+        sx = _mm512_fmadd_pd(si, rx, sx);
+        sy = _mm512_fmadd_pd(si, ry, sy);
+        sz = _mm512_fmadd_pd(si, rz, sz);
+        if constexpr (Potential) sp = _mm512_mask3_fmadd_pd(mi, inv, sp, valid);
+
+        if constexpr (Symmetric) {
+            __m512d sj = _mm512_mul_pd(mj, inv3);
+            _mm512_mask_storeu_pd(gx + i, lanes, _mm512_fnmadd_pd(sj, rx, _mm512_maskz_loadu_pd(lanes, gx + i)));
+            _mm512_mask_storeu_pd(gy + i, lanes, _mm512_fnmadd_pd(sj, ry, _mm512_maskz_loadu_pd(lanes, gy + i)));
+            _mm512_mask_storeu_pd(gz + i, lanes, _mm512_fnmadd_pd(sj, rz, _mm512_maskz_loadu_pd(lanes, gz + i)));
+        }
+    }
+
+    *target.gx += _mm512_reduce_add_pd(sx);
+    *target.gy += _mm512_reduce_add_pd(sy);
+    *target.gz += _mm512_reduce_add_pd(sz);
+    if constexpr (Potential) *target.potential += target.m * _mm512_reduce_add_pd(sp);
+}
+
+#endif
+
+using RangeFn = void (*)(BodyArrays &, const Target &, size_t, size_t);
+
+constexpr size_t kMinBlockSize = 256;
+constexpr size_t kMaxBlocks = 64;
+
+// Visits each unordered pair (i, j), i < j, with i in block [iBegin, iEnd) and j in
+// block [jBegin, jEnd). Bodies are topologically sorted, so only j can be excluded from
+// feeling i, namely when i is one of j's ancestors.
+template<bool Potential>
+void accumulateBlockPair(BodyArrays &bodies, RangeFn symmetricRange, size_t iBegin, size_t iEnd, size_t jBegin, size_t jEnd) {
+    for (size_t j = jBegin; j < jEnd; j++) {
+        size_t begin = iBegin;
+        size_t end = std::min(iEnd, j);
+        if (begin >= end) continue;
+        Target target = bodyTarget(bodies, j);
+
+        // The last exclusion entry is j itself
+        uint32_t last = bodies.excludedOffset[j + 1] - 1;
+        for (uint32_t k = bodies.excludedOffset[j]; k < last; k++) {
+            size_t ancestor = bodies.excluded[k];
+            if (ancestor < begin) continue;
+            if (ancestor >= end) break;
+            symmetricRange(bodies, target, begin, ancestor);
+            accumulateOneSided<Potential>(bodies, j, ancestor);
+            begin = ancestor + 1;
+        }
+        symmetricRange(bodies, target, begin, end);
+    }
+}
+
+// Splits the bodies into blocks and schedules block pairs in rounds where no two pairs
+// share a block, so a round's pairs can run concurrently without write conflicts. The
+// schedule only depends on the body count, which keeps every sum in the same order for
+// any thread count.
+template<bool Potential>
+void accumulatePairs(BodyArrays &bodies, RangeFn symmetricRange, ThreadPool *pool) {
+    size_t n = bodies.size();
+    size_t blockCount = std::clamp<size_t>(n / kMinBlockSize, 1, kMaxBlocks);
+    auto blockBegin = [&](size_t block) { return n * block / blockCount; };
+
+    // Diagonal blocks, all independent
+    parallelFor(pool, 0, blockCount, 1, [&](size_t first, size_t last) {
+        for (size_t b = first; b < last; b++) {
+            accumulateBlockPair<Potential>(bodies, symmetricRange, blockBegin(b), blockBegin(b + 1), blockBegin(b), blockBegin(b + 1));
+        }
+    });
+
+    // Off-diagonal blocks, round-robin tournament. With an odd block count, the extra
+    // slot is a bye.
+    size_t slots = blockCount + blockCount % 2;
+    std::vector<std::pair<size_t, size_t>> pairs;
+    for (size_t round = 0; round + 1 < slots; round++) {
+        pairs.clear();
+        pairs.emplace_back(round, slots - 1);
+        for (size_t k = 1; k < slots / 2; k++) {
+            pairs.emplace_back((round + k) % (slots - 1), (round + slots - 1 - k) % (slots - 1));
+        }
+
+        parallelFor(pool, 0, pairs.size(), 1, [&](size_t first, size_t last) {
+            for (size_t p = first; p < last; p++) {
+                size_t a = std::min(pairs[p].first, pairs[p].second);
+                size_t b = std::max(pairs[p].first, pairs[p].second);
+                if (b >= blockCount) continue;
+                accumulateBlockPair<Potential>(bodies, symmetricRange, blockBegin(a), blockBegin(a + 1), blockBegin(b), blockBegin(b + 1));
+            }
+        });
+    }
+}
+
+// Sums the pull of every body outside the exclusion set of body `chain`, in the gaps
+// between its entries. A chain of -1 excludes nothing.
+void accumulateOutsideChain(BodyArrays &bodies, const Target &target, int32_t chain, RangeFn oneSidedRange) {
+    size_t begin = 0;
+    if (chain >= 0) {
+        for (uint32_t k = bodies.excludedOffset[chain]; k < bodies.excludedOffset[chain + 1]; k++) {
+            size_t excluded = bodies.excluded[k];
+            oneSidedRange(bodies, target, begin, excluded);
+            begin = excluded + 1;
+        }
+    }
+    oneSidedRange(bodies, target, begin, bodies.size());
+}
+
+// Sums the pull of every body that target j does not exclude
+void accumulateTargets(BodyArrays &bodies, const std::vector<uint32_t> &targets, RangeFn oneSidedRange, ThreadPool *pool) {
+    parallelFor(pool, 0, targets.size(), 16, [&](size_t first, size_t last) {
+        for (size_t t = first; t < last; t++) {
+            size_t j = targets[t];
+            accumulateOutsideChain(bodies, bodyTarget(bodies, j), static_cast<int32_t>(j), oneSidedRange);
+        }
+    });
+}
+
+// Test particles are excluded from the same bodies as their primary, plus the primary
+void accumulateParticles(BodyArrays &bodies, TestParticleArrays &particles, RangeFn oneSidedRange, ThreadPool *pool) {
+    parallelFor(pool, 0, particles.size(), 256, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) {
+            Target target{ particles.ax[i], particles.ay[i], particles.az[i], 0.0, &particles.gx[i], &particles.gy[i], &particles.gz[i] };
+            accumulateOutsideChain(bodies, target, particles.primary[i], oneSidedRange);
+        }
+    });
+}
+
+} // namespace
+
+const char *gravityKernelName(GravityKernel kernel) {
+    switch (kernel) {
+        case GravityKernel::Scalar: return "scalar";
+        case GravityKernel::Avx2: return "avx2";
+        case GravityKernel::Avx512: return "avx512";
+    }
+    return "unknown";
+}
+
+bool isGravityKernelSupported(GravityKernel kernel) {
+    switch (kernel) {
+        case GravityKernel::Scalar: return true;
+#ifdef SFS_X86_KERNELS
+        case GravityKernel::Avx2: return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        case GravityKernel::Avx512: return __builtin_cpu_supports("avx512f");
+#endif
+        default: return false;
+    }
+}
+
+GravityKernel bestGravityKernel() {
+    static const GravityKernel best = [] {
+        if (isGravityKernelSupported(GravityKernel::Avx512)) return GravityKernel::Avx512;
+        if (isGravityKernelSupported(GravityKernel::Avx2)) return GravityKernel::Avx2;
+        return GravityKernel::Scalar;
+    }();
+    return best;
+}
+
+void accumulatePairwiseGravity(BodyArrays &bodies, GravityKernel kernel, ThreadPool *pool) {
+    switch (kernel) {
+#ifdef SFS_X86_KERNELS
+        case GravityKernel::Avx2: accumulatePairs<false>(bodies, accumulateRangeAvx2<true>, pool); break;
+        case GravityKernel::Avx512: accumulatePairs<false>(bodies, accumulateRangeAvx512<true>, pool); break;
+#endif
+        default: accumulatePairs<false>(bodies, accumulateRangeScalar<true>, pool); break;
+    }
+}
+
+void accumulatePairwiseGravityAndPotential(BodyArrays &bodies, GravityKernel kernel, ThreadPool *pool) {
+    switch (kernel) {
+#ifdef SFS_X86_KERNELS
+        case GravityKernel::Avx2: accumulatePairs<true>(bodies, accumulateRangeAvx2<true, true>, pool); break;
+        case GravityKernel::Avx512: accumulatePairs<true>(bodies, accumulateRangeAvx512<true, true>, pool); break;
+#endif
+        default: accumulatePairs<true>(bodies, accumulateRangeScalar<true, true>, pool); break;
+    }
+}
+
+void accumulateTargetGravity(BodyArrays &bodies, const std::vector<uint32_t> &targets, GravityKernel kernel, ThreadPool *pool) {
+    switch (kernel) {
+#ifdef SFS_X86_KERNELS
+        case GravityKernel::Avx2: accumulateTargets(bodies, targets, accumulateRangeAvx2<false>, pool); break;
+        case GravityKernel::Avx512: accumulateTargets(bodies, targets, accumulateRangeAvx512<false>, pool); break;
+#endif
+        default: accumulateTargets(bodies, targets, accumulateRangeScalar<false>, pool); break;
+    }
+}
+
+void accumulateTestParticleGravity(BodyArrays &bodies, TestParticleArrays &particles, GravityKernel kernel, ThreadPool *pool) {
+    switch (kernel) {
+#ifdef SFS_X86_KERNELS
+        case GravityKernel::Avx2: accumulateParticles(bodies, particles, accumulateRangeAvx2<false>, pool); break;
+        case GravityKernel::Avx512: accumulateParticles(bodies, particles, accumulateRangeAvx512<false>, pool); break;
+#endif
+        default: accumulateParticles(bodies, particles, accumulateRangeScalar<false>, pool); break;
+    }
+}
+
+} // namespace sfs::physics
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace sfs::physics {
+
+struct BodyArrays;
+struct TestParticleArrays;
+class ThreadPool;
+
+enum class GravityKernel {
+    Scalar,
+    Avx2,
+    Avx512,
+};
+
+const char *gravityKernelName(GravityKernel kernel);
+bool isGravityKernelSupported(GravityKernel kernel);
+
+// Widest kernel the running CPU supports, detected once
+GravityKernel bestGravityKernel();
+
+// Accumulates pairwise gravitational accelerations, without the G factor, into
+// gx/gy/gz. Each unordered pair is evaluated once and applied to both bodies, except
+// that a body never feels its own ancestors, whose pull is handled by Kepler
+// propagation. Pairs closer than 1000 km are skipped to avoid the singularity.
+//
+// Runs on `pool` if given. Results are bit-identical for any thread count.
+//
+// NB: Reads the absolute position cache, which must be up to date
+// NB: Caller must clear gx/gy/gz before calling
+void accumulatePairwiseGravity(BodyArrays &bodies, GravityKernel kernel, ThreadPool *pool = nullptr);
+
+// Same, and also adds each pair's m_i m_j / r to the potential of the later body, so the
+// potential energy costs one extra multiply-add per pair. Ancestor pairs count too, but
+// pairs closer than 1000 km do not.
+//
+// NB: Caller must clear the potentials before calling
+void accumulatePairwiseGravityAndPotential(BodyArrays &bodies, GravityKernel kernel, ThreadPool *pool = nullptr);
+
+// Same sums for the `targets` only, which are evaluated one-sided against every body.
+// Cheaper than the pairwise kernel while fewer than about half the bodies are targets.
+//
+// NB: Caller must clear gx/gy/gz of the targets before calling
+void accumulateTargetGravity(BodyArrays &bodies, const std::vector<uint32_t> &targets, GravityKernel kernel, ThreadPool *pool = nullptr);
+
+// Same one-sided sums for test particles, into their gx/gy/gz. Each particle ignores its
+// primary and the primary's ancestors. O(particles x bodies).
+//
+// NB: Reads both absolute position caches, which must be up to date
+// NB: Caller must clear the particles' gx/gy/gz before calling
+void accumulateTestParticleGravity(BodyArrays &bodies, TestParticleArrays &particles, GravityKernel kernel, ThreadPool *pool = nullptr);
+
+} // namespace sfs::physics
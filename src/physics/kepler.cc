@@ -4,29 +4,69 @@
 #include <cmath>
 #include <cassert>
 
+#include "physics/body_arrays.h"
+#include "physics/kepler_batch.h"
+#include "physics/parallel.h"
 #include "physics/physics.h"
+#include "physics/test_particles.h"
 
 namespace sfs::physics {
 
 namespace {
 
-double stumpff_C(double z) {
-    if (z > 1e-7) {
-        return (1 - cos(sqrt(z))) / z;
-    } else if (z < -1e-7) {
-        return (cosh(sqrt(-z)) - 1) / -z;
-    } else {
-        return 0.5 - z / 24 + z * z / 720;
+constexpr size_t kKeplerGrain = 256;  // Bodies per parallel chunk
+
+constexpr double kStumpffSeriesLimit = 1.0;  // |z| below which the Taylor series are used
+
+// Taylor series of the Stumpff functions C and S, accurate to rounding for |z| <= 1
+void stumpffSeries(double z, double &C, double &S) {
+    if (fabs(z) <= 1e-3) {
+        // Short steps and near-circular orbits, where four terms are enough
+        C = (1.0 - z * (1.0 / 12) * (1.0 - z * (1.0 / 30) * (1.0 - z * (1.0 / 56)))) * 0.5;
+        S = (1.0 - z * (1.0 / 20) * (1.0 - z * (1.0 / 42) * (1.0 - z * (1.0 / 72)))) * (1.0 / 6);
+        return;
     }
+    C = (1.0 - z * (1.0 / 12) * (1.0 - z * (1.0 / 30) * (1.0 - z * (1.0 / 56) * (1.0 - z * (1.0 / 90) * (1.0 - z * (1.0 / 132) *
+        (1.0 - z * (1.0 / 182) * (1.0 - z * (1.0 / 240) * (1.0 - z * (1.0 / 306) * (1.0 - z * (1.0 / 380)))))))))) * 0.5;
+    S = (1.0 - z * (1.0 / 20) * (1.0 - z * (1.0 / 42) * (1.0 - z * (1.0 / 72) * (1.0 - z * (1.0 / 110) * (1.0 - z * (1.0 / 156) *
+        (1.0 - z * (1.0 / 210) * (1.0 - z * (1.0 / 272) * (1.0 - z * (1.0 / 342) * (1.0 - z * (1.0 / 420)))))))))) * (1.0 / 6);
 }
 
-double stumpff_S(double z) {
-    if (z > 1e-7) {
-        return (sqrt(z) - sin(sqrt(z))) / (z * sqrt(z));
-    } else if (z < -1e-7) {
-        return (sinh(sqrt(-z)) - sqrt(-z)) / (-z * sqrt(-z));
+// C and S together, specialized on the orbit's regime so that the sign of z is known at
+// compile time. Outside the series range, both come from one sqrt and the half-angle
+// identities 1 - cos x = 2 sin^2(x / 2) and cosh x - 1 = 2 sinh^2(x / 2), which avoid the
+// cancellation in 1 - cos x.
+template<KeplerRegime R>
+void stumpff(double z, double &C, double &S) {
+    if (fabs(z) <= kStumpffSeriesLimit) {
+        stumpffSeries(z, C, S);
+    } else if constexpr (R == KeplerRegime::NearParabolic) {
+        // Only far from periapse does z leave the series range
+        if (z > 0.0) {
+            stumpff<KeplerRegime::Elliptic>(z, C, S);
+        } else {
+            stumpff<KeplerRegime::Hyperbolic>(z, C, S);
+        }
+    } else if constexpr (R == KeplerRegime::Elliptic) {
+        double x = sqrt(z);
+        // NB: GCC and Clang fuse these into a single sincos call
+        double s = sin(0.5 * x), c = cos(0.5 * x);
+        C = 2.0 * s * s / z;
+        S = (x - 2.0 * s * c) / (x * z);
     } else {
-        return 1.0 / 6.0 - z / 120 + z * z / 5040;
+        double x = sqrt(-z);
+        double ex = exp(0.5 * x);
+        double sh = 0.5 * (ex - 1.0 / ex), ch = 0.5 * (ex + 1.0 / ex);
+        C = 2.0 * sh * sh / -z;
+        S = (2.0 * sh * ch - x) / (x * -z);
+    }
+}
+
+void stumpff(const KeplerParameters &p, double z, double &C, double &S) {
+    switch (p.regime) {
+        case KeplerRegime::Elliptic: stumpff<KeplerRegime::Elliptic>(z, C, S); break;
+        case KeplerRegime::Hyperbolic: stumpff<KeplerRegime::Hyperbolic>(z, C, S); break;
+        case KeplerRegime::NearParabolic: stumpff<KeplerRegime::NearParabolic>(z, C, S); break;
     }
 }
 
@@ -42,40 +82,42 @@ double evaluateUniversalKeplerSecondDerivChi(const KeplerParameters &p, double c
     return p.r0_norm * p.r_dot / p.sqrt_mu * (1.0 - z * C) + (1.0 - p.alpha * p.r0_norm) * chi * (1.0 - z * S);
 }
 
-// Laguerre / Newton-Raphson iteration to solve for chi
-double solveUniversalKeplerEquation(const KeplerParameters &p, double dt, double *out_C, double *out_S) {
+template<KeplerRegime R>
+double solveRegime(const KeplerParameters &p, double dt, double *out_C, double *out_S, int *out_iterations, double chi_guess) {
     double r_peri = calculatePeriapse(p);
     double r_apo = calculateApoapse(p);
     double chi_max = p.sqrt_mu * dt / r_peri;
     double chi_min = p.alpha > 0 ? p.sqrt_mu * dt / r_apo : 0.0;
     double chi;
-    if (fabs(p.e - 1.0) < 0.01) {
+    if (!std::isnan(chi_guess)) {
+        chi = chi_guess;
+    } else if constexpr (R == KeplerRegime::NearParabolic) {
         // For roughly parabolic trajectories, we obtain a better estimate by exactly solving
         // Barker's equation.
-        // TODO: optimize this
-        double h = p.r0.cross(p.v0).norm();
-        double M_p = p.mu * p.mu * dt / (h * h * h);
+        double M_p = p.mu * p.mu * dt / (p.h * p.h * p.h);
         double z = cbrt(3 * M_p + sqrt(1 + 9 * M_p * M_p));
         double D = z - 1.0 / z;
-        chi = h / p.sqrt_mu * D;
+        chi = p.h / p.sqrt_mu * D;
     } else {
-        double z = p.alpha * chi_max * chi_max;
-        chi = p.mu * dt * dt / (r_peri * evaluateUniversalKepler(p, chi_max, stumpff_C(z), stumpff_S(z)));
+        double C, S;
+        stumpff<R>(p.alpha * chi_max * chi_max, C, S);
+        chi = p.mu * dt * dt / (r_peri * evaluateUniversalKepler(p, chi_max, C, S));
     }
     if (dt < 0.0) std::swap(chi_min, chi_max);
     if (std::isnan(chi)) chi = chi_min;
     chi = std::clamp(chi, chi_min, chi_max);
 
     int i = 0;
-    for (; i < 30; i++) {
+    for (; i < kKeplerMaxIterations; i++) {
         constexpr int n = 5;
         double z = p.alpha * chi * chi;
-        double C = stumpff_C(z);
-        double S = stumpff_S(z);
+        double C, S;
+        stumpff<R>(z, C, S);
         double F = evaluateUniversalKepler(p, chi, C, S) - p.sqrt_mu * dt;
         if (fabs(F / p.sqrt_mu) < 1e-12) {
             if (out_C) *out_C = C;
             if (out_S) *out_S = S;
+            if (out_iterations) *out_iterations = i;
             return chi;
         }
         double dF = evaluateUniversalKeplerDerivChi(p, chi, z, C, S);
@@ -89,16 +131,33 @@ double solveUniversalKeplerEquation(const KeplerParameters &p, double dt, double
         }
         chi = std::clamp(chi - delta, chi_min, chi_max);  // Prevent overshoot
         if (fabs(delta / std::max(1.0, fabs(chi))) < 1e-12) {
+            i++;
             break;
         }
     }
 
-    double z = p.alpha * chi * chi;
-    if (out_C) *out_C = stumpff_C(z);
-    if (out_S) *out_S = stumpff_S(z);
+    double C, S;
+    stumpff<R>(p.alpha * chi * chi, C, S);
+    if (out_C) *out_C = C;
+    if (out_S) *out_S = S;
+    if (out_iterations) *out_iterations = i;
     return chi;
 }
 
+} // namespace
+
+double solveUniversalKeplerEquation(const KeplerParameters &p, double dt, double *out_C, double *out_S, int *out_iterations, double chi_guess) {
+    switch (p.regime) {
+        case KeplerRegime::Elliptic:
+            return solveRegime<KeplerRegime::Elliptic>(p, dt, out_C, out_S, out_iterations, chi_guess);
+        case KeplerRegime::Hyperbolic:
+            return solveRegime<KeplerRegime::Hyperbolic>(p, dt, out_C, out_S, out_iterations, chi_guess);
+        case KeplerRegime::NearParabolic:
+            return solveRegime<KeplerRegime::NearParabolic>(p, dt, out_C, out_S, out_iterations, chi_guess);
+    }
+    return NAN;
+}
+
 void keplerPropagate(double chi, const KeplerParameters &p, double C, double S, double dt, Eigen::Vector3d &r, Eigen::Vector3d *v) {
     double z = p.alpha * chi * chi;
     double f = 1 - chi * chi / p.r0_norm * C;
@@ -113,11 +172,12 @@ void keplerPropagate(double chi, const KeplerParameters &p, double C, double S,
     }
 }
 
+namespace {
+
 // Kepler propagation with unknown dt
 void keplerPropagateUnknownTime(double chi, const KeplerParameters &p, Eigen::Vector3d &r, Eigen::Vector3d *v) {
-    double z = p.alpha * chi * chi;
-    double C = stumpff_C(z);
-    double S = stumpff_S(z);
+    double C, S;
+    stumpff(p, p.alpha * chi * chi, C, S);
     // TODO: possibly can be optimized by avoiding recalculation of dt
     double dt = (p.r0_norm * p.r_dot / p.sqrt_mu * chi * chi * C + (1.0 - p.alpha * p.r0_norm) * chi * chi * chi * S + p.r0_norm * chi) / p.sqrt_mu;
     keplerPropagate(chi, p, C, S, dt, r, v);
@@ -125,6 +185,24 @@ void keplerPropagateUnknownTime(double chi, const KeplerParameters &p, Eigen::Ve
 
 } // namespace
 
+KeplerParameters calculateKeplerParameters(const Eigen::Vector3d &r0, const Eigen::Vector3d &v0, double mu) {
+    double r0_norm = r0.norm();
+    double alpha = 2.0 / r0_norm - v0.squaredNorm() / mu;
+    double r_dot = r0.dot(v0) / r0_norm;
+    double h = r0.cross(v0).norm();
+    double e = sqrt(1 - h * h * alpha / mu);
+
+    KeplerRegime regime = KeplerRegime::Hyperbolic;
+    if (fabs(e - 1.0) < 0.01) {
+        regime = KeplerRegime::NearParabolic;
+    } else if (alpha > 0) {
+        regime = KeplerRegime::Elliptic;
+    }
+
+    return KeplerParameters{ .r0 = r0, .v0 = v0, .sqrt_mu = sqrt(mu), .r0_norm = r0_norm, .alpha = alpha, .r_dot = r_dot, .e = e, .mu = mu, .h = h,
+                             .regime = regime };
+}
+
 double calculatePeriapse(const KeplerParameters &p) {
     if (p.alpha > 0) {
         return (1.0 - p.e) / p.alpha;
@@ -132,7 +210,7 @@ double calculatePeriapse(const KeplerParameters &p) {
         return (p.e - 1.0) / -p.alpha;
     } else {
         // Parabolic orbit
-        return p.r0.cross(p.v0).squaredNorm() / (2.0 * p.sqrt_mu * p.sqrt_mu);
+        return p.h * p.h / (2.0 * p.sqrt_mu * p.sqrt_mu);
     }
 }
 
@@ -144,49 +222,132 @@ double calculateApoapse(const KeplerParameters &p) {
     }
 }
 
-// TODO: Technically, we do not have to recalculate parameters if no external forces are applied
-//  It is also better to avoid recalculation if no external forces occur since
-//  numerical errors can accumulate in alpha (the specific orbital energy) over
-//  time otherwise.
-void recalculateAllKeplerParameters(entt::registry &registry) {
-    auto view = registry.view<BodyState, KeplerParameters>();
-    for (auto entity : view) {
-        auto &state = view.get<BodyState>(entity);
-        if (state.st.primary == entt::null) continue;
+double estimateNextChi(double chi, double dt, const Eigen::Vector3d &r, const Eigen::Vector3d &v, double sqrt_mu) {
+    // Third order Taylor expansion of chi(t), from dchi/dt = sqrt(mu) / |r| and the radial
+    // acceleration of a Kepler orbit
+    double r_norm = r.norm();
+    double r_dot = r.dot(v) / r_norm;
+    double r_ddot = (v.squaredNorm() - r_dot * r_dot) / r_norm - sqrt_mu * sqrt_mu / (r_norm * r_norm);
+    double inv_r = 1.0 / r_norm;
+    double d1 = inv_r;
+    double d2 = -r_dot * inv_r * inv_r;
+    double d3 = (2.0 * r_dot * r_dot * inv_r - r_ddot) * inv_r * inv_r;
+    return chi + sqrt_mu * dt * (d1 + dt * (d2 / 2.0 + dt * d3 / 6.0));
+}
 
-        auto &primaryBody = registry.get<Body>(state.st.primary);
+namespace {
 
-        const Eigen::Vector3d &r0 = state.st.pos;
-        const Eigen::Vector3d &v0 = state.st.vel;
+// The templates below serve both BodyArrays and TestParticleArrays. `primaryMass(i)`
+// is the mass of entry i's primary, or 0 if the entry is not Kepler propagated.
+template<typename Arrays, typename PrimaryMass>
+void recalculateKeplerParameters(Arrays &arrays, ThreadPool *pool, bool onlyPerturbed, PrimaryMass primaryMass) {
+    parallelFor(pool, 0, arrays.size(), kKeplerGrain, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) {
+            double mass = primaryMass(i);
+            if (mass == 0.0) continue;
 
-        double mu = kGravitationalConstant * primaryBody.mass;
-        double r0_norm = r0.norm();
-        double alpha = 2.0 / r0_norm - v0.squaredNorm() / mu;
-        double r_dot = r0.dot(v0) / r0_norm;
-        double e = sqrt(1 - r0.cross(v0).squaredNorm() * alpha / mu);
+            double mu = kGravitationalConstant * mass;
+            if (onlyPerturbed && !arrays.perturbed[i] && arrays.kepler[i].mu == mu) continue;
+            arrays.kepler[i] = calculateKeplerParameters(Eigen::Vector3d(arrays.x[i], arrays.y[i], arrays.z[i]),
+                                                         Eigen::Vector3d(arrays.vx[i], arrays.vy[i], arrays.vz[i]), mu);
+            arrays.perturbed[i] = 0;
+        }
+    });
+}
 
-        view.get<KeplerParameters>(entity) =
-                KeplerParameters{ .r0 = r0, .v0 = v0, .sqrt_mu = sqrt(mu), .r0_norm = r0_norm, .alpha = alpha, .r_dot = r_dot, .e = e, .mu = mu };
-    }
+template<typename Arrays, typename HasOrbit>
+void propagateOrbits(Arrays &arrays, double dt, ThreadPool *pool, HasOrbit hasOrbit) {
+    parallelFor(pool, 0, arrays.size(), kKeplerGrain, [&](size_t first, size_t last) {
+        // Orbits in the chunk are solved together, so that the SIMD lanes stay full
+        size_t indices[kKeplerGrain];
+        const KeplerParameters *params[kKeplerGrain];
+        double dts[kKeplerGrain], guess[kKeplerGrain], chi[kKeplerGrain], C[kKeplerGrain], S[kKeplerGrain];
+        int iterations[kKeplerGrain];
+        size_t count = 0;
+        for (size_t i = first; i < last; i++) {
+            if (!hasOrbit(i)) continue;
+            const auto &p = arrays.kepler[i];
+            const auto &previous = arrays.solver[i];
+            indices[count] = i;
+            params[count] = &p;
+            dts[count] = p.elapsed + dt;
+
+            // Continue from the last solution if it belongs to the current epoch. A
+            // fresh epoch is solved exactly by chi = 0. Only near-parabolic orbits are
+            // warm-started: elsewhere the batch solver's own guess is about as close and
+            // cheaper than the scalar Taylor step, see the kepler_warm_start bench.
+            guess[count] = NAN;
+            if (p.regime == KeplerRegime::NearParabolic && (p.elapsed == 0.0 || (previous.converged && previous.dt == p.elapsed))) {
+                double chi0 = p.elapsed == 0.0 ? 0.0 : previous.chi;
+                guess[count] = estimateNextChi(chi0, dt, Eigen::Vector3d(arrays.x[i], arrays.y[i], arrays.z[i]),
+                                               Eigen::Vector3d(arrays.vx[i], arrays.vy[i], arrays.vz[i]), p.sqrt_mu);
+            }
+            count++;
+        }
+        if (count == 0) return;
+        solveUniversalKeplerBatch(params, dts, count, chi, C, S, iterations, guess);
+
+        for (size_t k = 0; k < count; k++) {
+            size_t i = indices[k];
+            Eigen::Vector3d r, v;
+            keplerPropagate(chi[k], *params[k], C[k], S[k], dts[k], r, &v);
+            if (!std::isfinite(r.squaredNorm() + v.squaredNorm())) {
+                // The Stumpff functions overflowed on a strongly hyperbolic arc, which the
+                // primary hardly bends. Drifts in a straight line instead and starts a fresh
+                // epoch, so that one bad arc cannot poison the force evaluation. The squared
+                // norms also catch positions too large to square in the direct sum.
+                arrays.x[i] += arrays.vx[i] * dt, arrays.y[i] += arrays.vy[i] * dt, arrays.z[i] += arrays.vz[i] * dt;
+                arrays.solver[i] = KeplerSolverState{};
+                arrays.perturbed[i] = 1;
+                continue;
+            }
+            arrays.kepler[i].elapsed = dts[k];
+            arrays.solver[i] = KeplerSolverState{ .chi = chi[k], .dt = dts[k], .converged = iterations[k] < kKeplerMaxIterations };
+
+            arrays.x[i] = r.x(), arrays.y[i] = r.y(), arrays.z[i] = r.z();
+            arrays.vx[i] = v.x(), arrays.vy[i] = v.y(), arrays.vz[i] = v.z();
+        }
+    });
 }
 
-void keplerPropagationSystem(entt::registry &registry, double dt) {
-    auto view = registry.view<BodyState, KeplerParameters>();
-    for (auto entity : view) {
-        auto &state = view.get<BodyState>(entity);
-        if (state.st.primary == entt::null) continue;
+void recalculateKeplerParameters(BodyArrays &bodies, ThreadPool *pool, bool onlyPerturbed) {
+    recalculateKeplerParameters(bodies, pool, onlyPerturbed, [&](size_t i) {
+        return bodies.hasKepler[i] && bodies.primary[i] >= 0 ? bodies.m[bodies.primary[i]] : 0.0;
+    });
+}
 
-        auto &p = view.get<KeplerParameters>(entity);
+} // namespace
 
-        double C, S;
-        double chi = solveUniversalKeplerEquation(p, dt, &C, &S);
+void recalculateAllKeplerParameters(BodyArrays &bodies, ThreadPool *pool) {
+    recalculateKeplerParameters(bodies, pool, false);
+}
 
-        Eigen::Vector3d r, v;
-        keplerPropagate(chi, p, C, S, dt, r, &v);
+void recalculatePerturbedKeplerParameters(BodyArrays &bodies, ThreadPool *pool) {
+    recalculateKeplerParameters(bodies, pool, true);
+}
 
-        state.st.pos = r;
-        state.st.vel = v;
-    }
+void recalculateAllKeplerParameters(entt::registry &registry) {
+    auto &bodies = gatherBodyArrays(registry);
+    recalculateAllKeplerParameters(bodies);
+    scatterBodyArrays(registry, bodies);
+}
+
+void keplerPropagationSystem(BodyArrays &bodies, double dt, ThreadPool *pool) {
+    propagateOrbits(bodies, dt, pool, [&](size_t i) { return bodies.hasKepler[i] && bodies.primary[i] >= 0; });
+}
+
+void recalculatePerturbedKeplerParameters(TestParticleArrays &particles, const BodyArrays &bodies, ThreadPool *pool) {
+    recalculateKeplerParameters(particles, pool, true, [&](size_t i) { return particles.primary[i] >= 0 ? bodies.m[particles.primary[i]] : 0.0; });
+}
+
+void keplerPropagationSystem(TestParticleArrays &particles, double dt, ThreadPool *pool) {
+    propagateOrbits(particles, dt, pool, [&](size_t i) { return particles.primary[i] >= 0; });
+}
+
+void keplerPropagationSystem(entt::registry &registry, double dt) {
+    auto &bodies = gatherBodyArrays(registry);
+    keplerPropagationSystem(bodies, dt);
+    scatterBodyArrays(registry, bodies);
 }
 
 void sampleTrajectoryPoints(const KeplerParameters &p, std::vector<Eigen::Vector3d> &points, int n) {
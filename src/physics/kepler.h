@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cmath>
+#include <cstdint>
 #include <vector>
 
 #include <Eigen/Dense>
@@ -7,6 +9,18 @@
 
 namespace sfs::physics {
 
+struct BodyArrays;
+struct TestParticleArrays;
+class ThreadPool;
+
+// Fixed when the parameters are computed, so that the solver does not branch on it per
+// iteration
+enum class KeplerRegime : uint8_t {
+    Elliptic,
+    Hyperbolic,
+    NearParabolic,  // |e - 1| < 0.01, started from Barker's equation
+};
+
 struct KeplerParameters {
     Eigen::Vector3d r0;
     Eigen::Vector3d v0;
@@ -16,13 +30,56 @@ struct KeplerParameters {
     double r_dot;
     double e;
     double mu;
+    double h;  // Specific angular momentum
+    KeplerRegime regime = KeplerRegime::Elliptic;
+    double elapsed = 0.0;  // Time propagated since the epoch state r0, v0
+};
+
+// Last solution of the universal Kepler equation for a body, which warm-starts the next
+// solve of a near-parabolic orbit. Only valid while `dt` matches the parameters' elapsed
+// time.
+struct KeplerSolverState {
+    double chi = 0.0;
+    double dt = 0.0;  // Time since the epoch that chi solves for
+    bool converged = false;
 };
 
+// Solves not converged after this many iterations return their last estimate
+constexpr int kKeplerMaxIterations = 30;
+
+KeplerParameters calculateKeplerParameters(const Eigen::Vector3d &r0, const Eigen::Vector3d &v0, double mu);
 double calculatePeriapse(const KeplerParameters &p);
 double calculateApoapse(const KeplerParameters &p);
 
+// Laguerre / Newton-Raphson iteration to solve for chi after dt seconds.
+// `out_iterations` receives the number of iterations taken, if not null.
+// Starts from `chi_guess` unless it is NaN, otherwise from an estimate based on the
+// periapse and apoapse, or on Barker's equation near e = 1.
+double solveUniversalKeplerEquation(const KeplerParameters &p, double dt, double *out_C, double *out_S, int *out_iterations = nullptr,
+                                   double chi_guess = NAN);
+
+// Warm start for the next solve: estimates chi a further dt after the solution `chi`,
+// where the body is at r, v relative to its primary
+double estimateNextChi(double chi, double dt, const Eigen::Vector3d &r, const Eigen::Vector3d &v, double sqrt_mu);
+
+// State relative to the primary after dt, from a solution of the universal Kepler equation
+void keplerPropagate(double chi, const KeplerParameters &p, double C, double S, double dt, Eigen::Vector3d &r, Eigen::Vector3d *v);
+
+// The BodyArrays overloads split the bodies across `pool` if given
 void recalculateAllKeplerParameters(entt::registry &registry);
+void recalculateAllKeplerParameters(BodyArrays &bodies, ThreadPool *pool = nullptr);
+// Only recalculates bodies marked as perturbed, or whose primary's mass changed, and
+// clears the marks. Unperturbed orbits keep their epoch state, which avoids the drift in
+// alpha that recomputing from propagated states accumulates.
+void recalculatePerturbedKeplerParameters(BodyArrays &bodies, ThreadPool *pool = nullptr);
+// Advances every orbit by dt, propagating from its epoch state by the total elapsed time.
+// An orbit whose state overflows drifts in a straight line instead and is marked perturbed.
 void keplerPropagationSystem(entt::registry &registry, double dt);
+void keplerPropagationSystem(BodyArrays &bodies, double dt, ThreadPool *pool = nullptr);
+
+// Test particle counterparts, with primaries indexing into `bodies`
+void recalculatePerturbedKeplerParameters(TestParticleArrays &particles, const BodyArrays &bodies, ThreadPool *pool = nullptr);
+void keplerPropagationSystem(TestParticleArrays &particles, double dt, ThreadPool *pool = nullptr);
 
 // NB: Caller must clear the `points` vector before calling
 // NB: Sampled points are relative to the primary's position at the current time
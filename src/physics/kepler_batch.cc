@@ -0,0 +1,220 @@
+#include "kepler_batch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "physics/kepler.h"
+
+namespace sfs::physics {
+
+namespace {
+
+#if defined(__AVX512F__)
+constexpr int kLanes = 8;
+#elif defined(__AVX__)
+constexpr int kLanes = 4;
+#else
+constexpr int kLanes = 2;
+#endif
+
+// GCC vector extensions, so that the solver reads like the scalar one. Comparisons give
+// per-lane masks of all ones or zeros, which select lanes through `?:`.
+typedef double Vec __attribute__((vector_size(8 * kLanes)));
+typedef int64_t IntVec __attribute__((vector_size(8 * kLanes)));
+using Mask = decltype(Vec{ } < Vec{ });
+
+constexpr double kTwoPi = 6.283185307179586;
+constexpr double kTwoPiLow = 2.4492935982947064e-16;  // 2 pi - kTwoPi
+
+Vec broadcast(double value) {
+    return Vec{ } + value;
+}
+
+Vec abs(Vec v) {
+    return v < 0.0 ? -v : v;
+}
+
+Vec sqrt(Vec v) {
+#if defined(__AVX512F__)
+    return _mm512_sqrt_pd(v);
+#elif defined(__AVX__)
+    return _mm256_sqrt_pd(v);
+#elif defined(__SSE2__)
+    return _mm_sqrt_pd(v);
+#else
+    for (int lane = 0; lane < kLanes; lane++) v[lane] = std::sqrt(v[lane]);
+    return v;
+#endif
+}
+
+Vec clamp(Vec v, Vec lo, Vec hi) {
+    // Same as std::clamp, lane by lane
+    return v < lo ? lo : (hi < v ? hi : v);
+}
+
+bool anyLane(Mask mask) {
+    for (int lane = 0; lane < kLanes; lane++) {
+        if (mask[lane]) return true;
+    }
+    return false;
+}
+
+// Stumpff functions C(z) and S(z) for every lane, without branching on the sign of z.
+//
+// z is quartered until the Taylor series of c2 = C and c3 = S converge, then scaled back
+// up with the quadruple-argument identities
+//   c0(4z) = 2 c0(z)^2 - 1     c1(4z) = c0(z) c1(z)
+//   c2(4z) = c1(z)^2 / 2       c3(4z) = (c2(z) + c0(z) c3(z)) / 4
+// where c0 = 1 - z c2 and c1 = 1 - z c3. Each step roughly doubles the rounding error,
+// so past one revolution (z > 4 pi^2) elliptic lanes are first reduced modulo 2 pi and
+// go through C = (1 - cos x) / z and S = (x - sin x) / (x z), which are well
+// conditioned there.
+void stumpff(Vec z, Vec &C, Vec &S) {
+    Mask revolutions = z > 4.0 * M_PI * M_PI;
+    Vec x = sqrt(revolutions ? z : broadcast(0.0));
+    // x is never negative, so truncation rounds to the nearest whole turn
+    Vec turns = __builtin_convertvector(__builtin_convertvector(x * (1.0 / kTwoPi) + 0.5, IntVec), Vec);
+    Vec reduced = (x - turns * kTwoPi) - turns * kTwoPiLow;
+    Vec w = revolutions ? reduced * reduced : z;
+
+    Vec steps = broadcast(0.0);
+    int maxSteps = 0;
+    // NB: The step limit stops lanes with infinite z from looping forever
+    for (Mask large = abs(w) > 0.1; anyLane(large) && maxSteps < 64; large = abs(w) > 0.1) {
+        w = large ? w * 0.25 : w;
+        steps = large ? steps + 1.0 : steps;
+        maxSteps++;
+    }
+
+    // Reciprocal constants, since vector division is far slower than multiplication
+    Vec c2 = (1.0 - w * (1.0 / 12) * (1.0 - w * (1.0 / 30) * (1.0 - w * (1.0 / 56) * (1.0 - w * (1.0 / 90) * (1.0 - w * (1.0 / 132) * (1.0 - w * (1.0 / 182))))))) * 0.5;
+    Vec c3 = (1.0 - w * (1.0 / 20) * (1.0 - w * (1.0 / 42) * (1.0 - w * (1.0 / 72) * (1.0 - w * (1.0 / 110) * (1.0 - w * (1.0 / 156) * (1.0 - w * (1.0 / 210))))))) * (1.0 / 6);
+    Vec c0 = 1.0 - w * c2;
+    Vec c1 = 1.0 - w * c3;
+    for (int step = 0; step < maxSteps; step++) {
+        Mask active = steps > static_cast<double>(step);
+        Vec n3 = (c2 + c0 * c3) * 0.25;
+        Vec n2 = c1 * c1 * 0.5;
+        Vec n1 = c0 * c1;
+        Vec n0 = 2.0 * c0 * c0 - 1.0;
+        c3 = active ? n3 : c3;
+        c2 = active ? n2 : c2;
+        c1 = active ? n1 : c1;
+        c0 = active ? n0 : c0;
+    }
+
+    // c0 and c1 are now cos and sin / x of the reduced angle
+    Vec zSafe = revolutions ? z : broadcast(1.0);
+    Vec xSafe = revolutions ? x : broadcast(1.0);
+    C = revolutions ? (1.0 - c0) / zSafe : c2;
+    S = revolutions ? (x - reduced * c1) / (xSafe * zSafe) : c3;
+}
+
+// Same initial estimate from Barker's equation as solveUniversalKeplerEquation
+double barkerEstimate(const KeplerParameters &p, double dt) {
+    double M_p = p.mu * p.mu * dt / (p.h * p.h * p.h);
+    double z = std::cbrt(3 * M_p + std::sqrt(1 + 9 * M_p * M_p));
+    double D = z - 1.0 / z;
+    return p.h / p.sqrt_mu * D;
+}
+
+// Solves up to kLanes orbits. Missing lanes repeat the last orbit and are not written.
+void solveLanes(const KeplerParameters *const *params, const double *dtIn, const double *guess, int count, double *out_chi, double *out_C,
+                double *out_S, int *out_iterations) {
+    Vec r0_norm, r_dot_term, energy_term, sqrt_mu, alpha, mu, e, dt;
+    for (int lane = 0; lane < kLanes; lane++) {
+        const auto &p = *params[std::min(lane, count - 1)];
+        r0_norm[lane] = p.r0_norm;
+        r_dot_term[lane] = p.r0_norm * p.r_dot / p.sqrt_mu;
+        energy_term[lane] = 1.0 - p.alpha * p.r0_norm;
+        sqrt_mu[lane] = p.sqrt_mu;
+        alpha[lane] = p.alpha;
+        mu[lane] = p.mu;
+        e[lane] = p.e;
+        dt[lane] = dtIn[std::min(lane, count - 1)];
+    }
+    auto evaluate = [&](Vec chi, Vec C, Vec S) {
+        return r_dot_term * chi * chi * C + energy_term * chi * chi * chi * S + r0_norm * chi;
+    };
+
+    // Same as calculatePeriapse and calculateApoapse
+    Vec r_peri = (alpha > 0.0 ? 1.0 - e : e - 1.0) / (alpha > 0.0 ? alpha : -alpha);
+    Vec r_apo = (1.0 + e) / alpha;
+    for (int lane = 0; lane < kLanes; lane++) {
+        if (alpha[lane] == 0.0) r_peri[lane] = calculatePeriapse(*params[std::min(lane, count - 1)]);
+    }
+
+    Vec chi_max = sqrt_mu * dt / r_peri;
+    Vec chi_min = alpha > 0.0 ? sqrt_mu * dt / r_apo : broadcast(0.0);
+    Vec C, S;
+    stumpff(alpha * chi_max * chi_max, C, S);
+    Vec chi = mu * dt * dt / (r_peri * evaluate(chi_max, C, S));
+    for (int lane = 0; lane < kLanes; lane++) {
+        int k = std::min(lane, count - 1);
+        if (guess && !std::isnan(guess[k])) {
+            chi[lane] = guess[k];
+        } else if (params[k]->regime == KeplerRegime::NearParabolic) {
+            chi[lane] = barkerEstimate(*params[k], dt[lane]);
+        }
+    }
+
+    Mask backwards = dt < 0.0;
+    Vec lo = backwards ? chi_max : chi_min;
+    Vec hi = backwards ? chi_min : chi_max;
+    chi = chi != chi ? lo : chi;
+    chi = clamp(chi, lo, hi);
+
+    Mask active = broadcast(0.0) == 0.0;
+    Vec iterations = broadcast(kKeplerMaxIterations);
+    for (int i = 0; i < kKeplerMaxIterations && anyLane(active); i++) {
+        constexpr double n = 5;
+        Vec z = alpha * chi * chi;
+        stumpff(z, C, S);
+        Vec F = evaluate(chi, C, S) - sqrt_mu * dt;
+        Mask converged = active & (abs(F / sqrt_mu) < 1e-12);
+        iterations = converged ? broadcast(i) : iterations;
+        active &= ~converged;
+
+        Vec dF = r_dot_term * chi * (1.0 - z * S) + energy_term * chi * chi * C + r0_norm;
+        Vec d2F = r_dot_term * (1.0 - z * C) + energy_term * chi * (1.0 - z * S);
+        Vec D = (n - 1) * (n - 1) * dF * dF - n * (n - 1) * F * d2F;
+        Mask laguerre = D > 1e-7;
+        Vec root = sqrt(laguerre ? D : broadcast(0.0));
+        Vec delta = laguerre ? n * F / (dF + (dF < 0.0 ? -root : root)) : F / dF;
+
+        chi = active ? clamp(chi - delta, lo, hi) : chi;
+        Mask stepped = active & (abs(delta / (abs(chi) < 1.0 ? broadcast(1.0) : abs(chi))) < 1e-12);
+        iterations = stepped ? broadcast(i + 1) : iterations;
+        active &= ~stepped;
+    }
+
+    stumpff(alpha * chi * chi, C, S);
+    for (int lane = 0; lane < count; lane++) {
+        out_chi[lane] = chi[lane];
+        if (out_C) out_C[lane] = C[lane];
+        if (out_S) out_S[lane] = S[lane];
+        if (out_iterations) out_iterations[lane] = static_cast<int>(iterations[lane]);
+    }
+}
+
+} // namespace
+
+size_t keplerBatchLanes() {
+    return kLanes;
+}
+
+void solveUniversalKeplerBatch(const KeplerParameters *const *params, const double *dt, size_t count, double *out_chi, double *out_C, double *out_S,
+                               int *out_iterations, const double *chi_guess) {
+    for (size_t i = 0; i < count; i += kLanes) {
+        int lanes = static_cast<int>(std::min<size_t>(kLanes, count - i));
+        solveLanes(params + i, dt + i, chi_guess ? chi_guess + i : nullptr, lanes, out_chi + i, out_C ? out_C + i : nullptr,
+                   out_S ? out_S + i : nullptr, out_iterations ? out_iterations + i : nullptr);
+    }
+}
+
+} // namespace sfs::physics
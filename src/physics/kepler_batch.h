@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+
+namespace sfs::physics {
+
+struct KeplerParameters;
+
+// Orbits solved per SIMD register: 8 with AVX-512, 4 with AVX, 2 otherwise. Picked at
+// compile time from the target architecture.
+size_t keplerBatchLanes();
+
+// Batch counterpart of solveUniversalKeplerEquation, solving `count` independent orbits,
+// each by its own dt. Lanes iterate in lockstep and drop out as they converge, and each
+// lane falls back from Laguerre to Newton on its own. The Stumpff functions are
+// evaluated without branching on the regime, so results agree with the scalar solver to
+// within its tolerance rather than bit for bit.
+//
+// `out_iterations` receives the per-orbit iteration counts, if not null. Orbits start
+// from `chi_guess` where given and not NaN, like the scalar solver.
+void solveUniversalKeplerBatch(const KeplerParameters *const *params, const double *dt, size_t count, double *out_chi, double *out_C, double *out_S,
+                               int *out_iterations = nullptr, const double *chi_guess = nullptr);
+
+} // namespace sfs::physics
@@ -0,0 +1,124 @@
+#include "parallel.h"
+
+namespace sfs::physics {
+
+namespace {
+
+uint64_t packRange(uint32_t next, uint32_t end) {
+    return static_cast<uint64_t>(next) | static_cast<uint64_t>(end) << 32;
+}
+
+} // namespace
+
+ThreadPool::ThreadPool(unsigned threadCount) : threadCount_(threadCount) {
+    if (threadCount_ == 0) threadCount_ = std::max(1u, std::thread::hardware_concurrency());
+
+    runs_ = std::make_unique<ChunkRun[]>(threadCount_);
+    for (unsigned w = 0; w < threadCount_; w++) runs_[w].range.store(0, std::memory_order_relaxed);
+    for (unsigned w = 1; w < threadCount_; w++) threads_.emplace_back(&ThreadPool::workerLoop, this, w);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto &thread : threads_) thread.join();
+}
+
+void ThreadPool::parallelFor(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)> &fn) {
+    if (begin >= end) return;
+    grain = std::max<size_t>(grain, 1);
+    auto chunkCount = static_cast<uint32_t>((end - begin + grain - 1) / grain);
+
+    {
+        std::lock_guard lock(mutex_);
+        fn_ = &fn;
+        begin_ = begin, end_ = end, grain_ = grain;
+        remainingChunks_.store(chunkCount, std::memory_order_relaxed);
+
+        // Deal each worker a contiguous run of chunks
+        for (unsigned w = 0; w < threadCount_; w++) {
+            auto first = static_cast<uint32_t>(static_cast<uint64_t>(chunkCount) * w / threadCount_);
+            auto last = static_cast<uint32_t>(static_cast<uint64_t>(chunkCount) * (w + 1) / threadCount_);
+            runs_[w].range.store(packRange(first, last), std::memory_order_release);
+        }
+        generation_++;
+    }
+    wake_.notify_all();
+
+    runChunks(0);
+
+    // Workers that joined this job must be done with it before the next one is published
+    while (remainingChunks_.load(std::memory_order_acquire) != 0 || activeWorkers_.load(std::memory_order_acquire) != 0) {
+        std::this_thread::yield();
+    }
+}
+
+void ThreadPool::workerLoop(unsigned worker) {
+    uint64_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock lock(mutex_);
+            wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+            if (stop_) return;
+            seen = generation_;
+            activeWorkers_.fetch_add(1, std::memory_order_acq_rel);
+        }
+        runChunks(worker);
+        activeWorkers_.fetch_sub(1, std::memory_order_acq_rel);
+    }
+}
+
+void ThreadPool::runChunks(unsigned worker) {
+    uint32_t chunk;
+    while (takeOwn(worker, chunk)) runChunk(chunk);
+
+    // Keep stealing until every run is empty
+    bool found = true;
+    while (found) {
+        found = false;
+        for (unsigned k = 1; k < threadCount_; k++) {
+            unsigned victim = (worker + k) % threadCount_;
+            while (steal(victim, chunk)) {
+                runChunk(chunk);
+                found = true;
+            }
+        }
+    }
+}
+
+bool ThreadPool::takeOwn(unsigned worker, uint32_t &chunk) {
+    auto &range = runs_[worker].range;
+    uint64_t current = range.load(std::memory_order_acquire);
+    while (true) {
+        auto next = static_cast<uint32_t>(current), end = static_cast<uint32_t>(current >> 32);
+        if (next >= end) return false;
+        if (range.compare_exchange_weak(current, packRange(next + 1, end), std::memory_order_acq_rel)) {
+            chunk = next;
+            return true;
+        }
+    }
+}
+
+bool ThreadPool::steal(unsigned victim, uint32_t &chunk) {
+    auto &range = runs_[victim].range;
+    uint64_t current = range.load(std::memory_order_acquire);
+    while (true) {
+        auto next = static_cast<uint32_t>(current), end = static_cast<uint32_t>(current >> 32);
+        if (next >= end) return false;
+        if (range.compare_exchange_weak(current, packRange(next, end - 1), std::memory_order_acq_rel)) {
+            chunk = end - 1;
+            return true;
+        }
+    }
+}
+
+void ThreadPool::runChunk(uint32_t chunk) {
+    size_t chunkBegin = begin_ + static_cast<size_t>(chunk) * grain_;
+    (*fn_)(chunkBegin, std::min(chunkBegin + grain_, end_));
+    remainingChunks_.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+} // namespace sfs::physics
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sfs::physics {
+
+// Fixed-size pool of worker threads running chunked parallel-for loops.
+//
+// Each call splits its range into chunks of `grain` elements and deals contiguous runs
+// of chunks to the workers. A worker takes chunks from the front of its own run and,
+// once that is empty, steals from the back of the other workers' runs.
+//
+// Chunk boundaries depend only on the range and the grain, never on the thread count or
+// on which worker runs a chunk, so callers that write disjoint outputs per chunk, or
+// combine per-chunk partial results in chunk order, get bit-identical results for any
+// thread count.
+//
+// NB: The calling thread takes part as worker 0. Calls must not be nested.
+class ThreadPool {
+public:
+    // 0 threads means one per hardware thread
+    explicit ThreadPool(unsigned threadCount);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    unsigned threadCount() const { return threadCount_; }
+
+    // Calls fn(chunkBegin, chunkEnd) for every chunk of [begin, end)
+    void parallelFor(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)> &fn);
+
+private:
+    struct alignas(64) ChunkRun {
+        std::atomic<uint64_t> range;  // Low 32 bits: next chunk, high 32 bits: end chunk
+    };
+
+    void workerLoop(unsigned worker);
+    void runChunks(unsigned worker);
+    bool takeOwn(unsigned worker, uint32_t &chunk);
+    bool steal(unsigned victim, uint32_t &chunk);
+    void runChunk(uint32_t chunk);
+
+    unsigned threadCount_;
+    std::vector<std::thread> threads_;
+    std::unique_ptr<ChunkRun[]> runs_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    uint64_t generation_ = 0;
+    bool stop_ = false;
+    std::atomic<unsigned> activeWorkers_{ 0 };
+    std::atomic<size_t> remainingChunks_{ 0 };
+
+    // Current job, published under `mutex_`
+    const std::function<void(size_t, size_t)> *fn_ = nullptr;
+    size_t begin_ = 0, end_ = 0, grain_ = 1;
+};
+
+// Runs the same chunks serially when `pool` is null or has a single thread
+inline void parallelFor(ThreadPool *pool, size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)> &fn) {
+    if (pool && pool->threadCount() > 1) {
+        pool->parallelFor(begin, end, grain, fn);
+        return;
+    }
+    for (size_t chunk = begin; chunk < end; chunk += grain) fn(chunk, std::min(chunk + grain, end));
+}
+
+} // namespace sfs::physics
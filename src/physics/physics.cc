@@ -1,150 +1,439 @@
 #include "physics.h"
 
+#include <algorithm>
 #include <cmath>
+#include <memory>
+#include <vector>
 
+#include "physics/barnes_hut.h"
+#include "physics/block_timesteps.h"
+#include "physics/body_arrays.h"
+#include "physics/diagnostics.h"
+#include "physics/gravity_kernels.h"
 #include "physics/kepler.h"
+#include "physics/parallel.h"
+#include "physics/sphere_of_influence.h"
+#include "physics/test_particles.h"
 
 namespace sfs::physics {
 
 namespace {
 
-void gravitySystem(entt::registry &registry) {
-    auto view1 = registry.view<ForceAccumulator, BodyState, Body>();
-    auto view2 = registry.view<BodyState, Body>();
-    for (auto a : view1) {
-        auto &stateA = view1.get<BodyState>(a);
-        auto &bodyA = view1.get<Body>(a);
-        auto &forceAcc = view1.get<ForceAccumulator>(a);
-
-        Eigen::Vector3d posA = calculateAbsolutePosition(registry, stateA);
-
-        // We use primary gravity to track the strongest gravitational influence.
-        // If there is a stronger influence than the current primary, we change the
-        // primary to that body.
-        // TODO: reimplement this
-        // Eigen::Vector3d primaryGravity = Eigen::Vector3d::Zero();
-        // if (bodyA.primary != entt::null) {
-        //     auto &state = registry.get<BodyState>(bodyA.primary);
-        //     auto &body = registry.get<Body>(bodyA.primary);
-        //     Eigen::Vector3d r = state.st.pos - stateA.st.pos;
-        //     double norm = r.norm();
-        //     primaryGravity = kGravitationalConstant * bodyA.mass * body.mass * r / (norm * norm * norm);
-        // }
-
-        for (auto b : view2) {
-            if (a == b) continue;
-            auto &stateB = view2.get<BodyState>(b);
-            auto &bodyB = view2.get<Body>(b);
-            if (isParentBody<BodyState>(registry, a, b)) continue; // Parents' gravity is handled by Kepler propagation or Jacobi coordinates
-
-            Eigen::Vector3d r = calculateAbsolutePosition(registry, stateB) - posA;
-            double norm = r.norm();
-            if (norm < 1e6) continue; // Avoid singularity
-
-            Eigen::Vector3d gravity = kGravitationalConstant * bodyA.mass * bodyB.mass * r / (norm * norm * norm);
-            // if (gravity.squaredNorm() < primaryGravity.squaredNorm()) {
-            forceAcc.force += gravity;
-            // } else {
-            //     // Apply old primary's gravity, as Kepler no longer handles it
-            //     if (bodyA.primary != entt::null) {
-            //         forceAcc.force += primaryGravity;
-            //     }
-            //
-            //     // Do not apply capturer's gravitational force if we capture since Kepler
-            //     // propagation will handle it.
-            //     primaryGravity = gravity;
-            //     bodyA.primary = b;
-            // }
+constexpr size_t kBodyGrain = 1024;  // Bodies per parallel chunk for cheap loops
+
+// Leapfrog stage weights, from Yoshida (1990)
+constexpr double kYoshida4[] = { 1.3512071919596578, -1.7024143839193153, 1.3512071919596578 };
+constexpr double kYoshida6[] = { 0.784513610477560, 0.235573213359357, -1.17767998417887, 1.31518632068391,
+                                 -1.17767998417887, 0.235573213359357, 0.784513610477560 };
+
+// Symplectic corrector stages, after Wisdom, Holman & Touma (1996): stage k drifts by
+// k * kCorrectorDrift * dt and kicks by b_k * dt. The b_k of each order cancel the error
+// terms of the leapfrog map up to that order, to first order in the perturbation.
+constexpr double kCorrectorDrift = 0.41833001326703777;  // sqrt(7 / 40)
+constexpr double kCorrector3[] = { 0.024900596027799867 };
+constexpr double kCorrector5[] = { 0.041500993379666446, -0.0083001986759332892 };
+constexpr double kCorrector7[] = { 0.053964399093127499, -0.018270923246702131, 0.0024926811426922106 };
+
+struct PhysicsThreadPool {
+    unsigned requested = 1;
+    std::unique_ptr<ThreadPool> pool;
+};
+
+// Scratch copy the symplectic corrector runs on, kept so that copying does not allocate
+struct CorrectedBodyArrays {
+    BodyArrays bodies;
+};
+
+void clearAccelerations(BodyArrays &bodies) {
+    std::fill(bodies.gx.begin(), bodies.gx.end(), 0.0);
+    std::fill(bodies.gy.begin(), bodies.gy.end(), 0.0);
+    std::fill(bodies.gz.begin(), bodies.gz.end(), 0.0);
+}
+
+void clearForces(BodyArrays &bodies) {
+    std::fill(bodies.fx.begin(), bodies.fx.end(), 0.0);
+    std::fill(bodies.fy.begin(), bodies.fy.end(), 0.0);
+    std::fill(bodies.fz.begin(), bodies.fz.end(), 0.0);
+}
+
+void applyAccelerations(BodyArrays &bodies, ThreadPool *pool) {
+    parallelFor(pool, 0, bodies.size(), kBodyGrain, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) {
+            double scale = bodies.hasForce[i] ? kGravitationalConstant * bodies.m[i] : 0.0;
+            bodies.fx[i] += scale * bodies.gx[i];
+            bodies.fy[i] += scale * bodies.gy[i];
+            bodies.fz[i] += scale * bodies.gz[i];
         }
+    });
+}
+
+void barnesHutGravitySystem(entt::registry &registry, BodyArrays &bodies, double theta, ThreadPool *pool) {
+    auto &tree = registry.ctx().emplace<BarnesHutTree>();
+    buildBarnesHutTree(bodies, tree);
+
+    clearAccelerations(bodies);
+    accumulateBarnesHutGravity(bodies, tree, theta, pool);
+    applyAccelerations(bodies, pool);
+}
+
+// Direct sum that also fills the capture with the states it saw. Those are the absolute
+// states at the kick, before it is applied.
+void capturingGravitySystem(BodyArrays &bodies, DiagnosticsCapture &capture, ThreadPool *pool) {
+    clearAccelerations(bodies);
+    std::fill(bodies.potential.begin(), bodies.potential.end(), 0.0);
+    accumulatePairwiseGravityAndPotential(bodies, bestGravityKernel(), pool);
+    applyAccelerations(bodies, pool);
+
+    auto &snapshot = capture.snapshot;
+    snapshot.x = bodies.ax, snapshot.y = bodies.ay, snapshot.z = bodies.az;
+    snapshot.vx = bodies.avx, snapshot.vy = bodies.avy, snapshot.vz = bodies.avz;
+    snapshot.m = bodies.m;
+    snapshot.potential = 0.0;
+    for (double p : bodies.potential) snapshot.potential += p;
+    snapshot.hasPotential = true;
+    capture.requested = false;
+    capture.captured = true;
+}
+
+void gravitySystem(entt::registry &registry, BodyArrays &bodies, ThreadPool *pool) {
+    const auto &settings = registry.ctx().emplace<PhysicsSettings>();
+    // NB: Mapped states are not real ones, so nothing is captured with a corrector on
+    bool corrected = !settings.blockTimesteps && settings.integrator == Integrator::Leapfrog && settings.correctorOrder != 0;
+    auto *capture = registry.ctx().find<DiagnosticsCapture>();
+    if (settings.gravityMode == GravityMode::BarnesHut) {
+        barnesHutGravitySystem(registry, bodies, settings.openingAngle, pool);
+    } else if (capture && capture->requested && !corrected) {
+        capturingGravitySystem(bodies, *capture, pool);
+    } else {
+        gravitySystem(bodies, pool);
     }
 }
 
-void momentumKick(entt::registry &registry, double dt) {
-    auto forcesView = registry.view<ForceAccumulator, BodyState, Body>();
-    for (auto entity : forcesView) {
-        auto &forceAcc = forcesView.get<ForceAccumulator>(entity);
-        forceAcc.force.setZero();
+// Same as gravitySystem, but only evaluates and overwrites the forces of `targets`
+void targetGravitySystem(entt::registry &registry, BodyArrays &bodies, const std::vector<uint32_t> &targets, ThreadPool *pool) {
+    for (uint32_t i : targets) {
+        bodies.fx[i] = bodies.fy[i] = bodies.fz[i] = 0.0;
+        bodies.gx[i] = bodies.gy[i] = bodies.gz[i] = 0.0;
+    }
+
+    const auto &settings = registry.ctx().emplace<PhysicsSettings>();
+    if (settings.gravityMode == GravityMode::BarnesHut) {
+        auto &tree = registry.ctx().emplace<BarnesHutTree>();
+        buildBarnesHutTree(bodies, tree);
+        accumulateBarnesHutGravity(bodies, tree, settings.openingAngle, pool, &targets);
+    } else {
+        accumulateTargetGravity(bodies, targets, bestGravityKernel(), pool);
     }
 
-    gravitySystem(registry);
+    for (uint32_t i : targets) {
+        double scale = bodies.hasForce[i] ? kGravitationalConstant * bodies.m[i] : 0.0;
+        bodies.fx[i] = scale * bodies.gx[i];
+        bodies.fy[i] = scale * bodies.gy[i];
+        bodies.fz[i] = scale * bodies.gz[i];
+    }
+}
 
-    for (auto entity : forcesView) {
-        auto &forceAcc = forcesView.get<ForceAccumulator>(entity);
-        auto &state = forcesView.get<BodyState>(entity);
-        auto &body = forcesView.get<Body>(entity);
-        state.st.vel += dt * forceAcc.force / body.mass;
+} // namespace
+
+ThreadPool *getPhysicsThreadPool(entt::registry &registry) {
+    unsigned requested = registry.ctx().emplace<PhysicsSettings>().threadCount;
+    auto &holder = registry.ctx().emplace<PhysicsThreadPool>();
+    if (holder.requested != requested) {
+        holder.pool.reset();
+        holder.requested = requested;
     }
+    if (requested != 1 && !holder.pool) holder.pool = std::make_unique<ThreadPool>(requested);
+    return holder.pool && holder.pool->threadCount() > 1 ? holder.pool.get() : nullptr;
+}
+
+void gravitySystem(BodyArrays &bodies, GravityKernel kernel, ThreadPool *pool) {
+    // Parents' gravity is handled by Kepler propagation or Jacobi coordinates, which
+    // the kernel takes care of through the exclusion sets. Primaries are switched by
+    // sphere of influence at the end of physicsUpdate.
+    clearAccelerations(bodies);
+    accumulatePairwiseGravity(bodies, kernel, pool);
+    applyAccelerations(bodies, pool);
+}
+
+void gravitySystem(BodyArrays &bodies, ThreadPool *pool) {
+    gravitySystem(bodies, bestGravityKernel(), pool);
+}
+
+void gravitySystem(entt::registry &registry) {
+    auto &bodies = gatherBodyArrays(registry);
+    gravitySystem(registry, bodies, getPhysicsThreadPool(registry));
+    scatterBodyArrays(registry, bodies);
+}
+
+namespace {
+
+void kickBody(BodyArrays &bodies, size_t i, double dt) {
+    double scale = bodies.hasForce[i] ? dt / bodies.m[i] : 0.0;
+    double dvx = scale * bodies.fx[i], dvy = scale * bodies.fy[i], dvz = scale * bodies.fz[i];
+    if (dvx != 0.0 || dvy != 0.0 || dvz != 0.0) bodies.perturbed[i] = 1;
+    bodies.vx[i] += dvx;
+    bodies.vy[i] += dvy;
+    bodies.vz[i] += dvz;
 }
 
-void linearDriftRootBodies(entt::registry &registry, double dt) {
+void momentumKick(entt::registry &registry, BodyArrays &bodies, double dt, ThreadPool *pool) {
+    clearForces(bodies);
+    gravitySystem(registry, bodies, pool);
+
+    parallelFor(pool, 0, bodies.size(), kBodyGrain, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) kickBody(bodies, i, dt);
+    });
+    registry.ctx().emplace<PhysicsStatistics>().forceEvaluations += bodies.size();
+}
+
+// Kicks the bodies in `bodies.active`, each by dt / 2^level. Falls back to the
+// pairwise kernel when most bodies are due, where the one-sided sums would be slower.
+void blockMomentumKick(entt::registry &registry, BodyArrays &bodies, double dt, ThreadPool *pool) {
+    const auto &active = bodies.active;
+    auto &statistics = registry.ctx().emplace<PhysicsStatistics>();
+    if (2 * active.size() >= bodies.size()) {
+        clearForces(bodies);
+        gravitySystem(registry, bodies, pool);
+        statistics.forceEvaluations += bodies.size();
+    } else {
+        targetGravitySystem(registry, bodies, active, pool);
+        statistics.forceEvaluations += active.size();
+    }
+
+    parallelFor(pool, 0, active.size(), kBodyGrain, [&](size_t first, size_t last) {
+        for (size_t k = first; k < last; k++) kickBody(bodies, active[k], std::ldexp(dt, -bodies.timestepLevel[active[k]]));
+    });
+}
+
+void linearDriftRootBodies(BodyArrays &bodies, double dt) {
     // Drift bodies without parents linearly
-    auto view = registry.view<BodyState, Body>();
-    for (auto entity : view) {
-        auto &state = view.get<BodyState>(entity);
-        if (state.st.primary != entt::null) continue;
+    for (size_t i = 0; i < bodies.size(); i++) {
+        double scale = bodies.primary[i] < 0 ? dt : 0.0;
+        bodies.x[i] += scale * bodies.vx[i];
+        bodies.y[i] += scale * bodies.vy[i];
+        bodies.z[i] += scale * bodies.vz[i];
+    }
+}
+
+void keplerDrift(BodyArrays &bodies, double dt, ThreadPool *pool) {
+    recalculatePerturbedKeplerParameters(bodies, pool);
+    keplerPropagationSystem(bodies, dt, pool);
+}
+
+void positionDrift(BodyArrays &bodies, double dt, ThreadPool *pool) {
+    linearDriftRootBodies(bodies, dt);
+    keplerDrift(bodies, dt, pool);
+}
+
+// Runs leapfrog stages of weights[k] * dt back to back, merging the half drifts
+// between stages
+void composedStep(entt::registry &registry, BodyArrays &bodies, double dt, const double *weights, size_t count, ThreadPool *pool) {
+    double drift = 0.5 * weights[0] * dt;
+    for (size_t k = 0; k < count; k++) {
+        positionDrift(bodies, drift, pool);
+        calculateAbsoluteStates(bodies);
+        momentumKick(registry, bodies, weights[k] * dt, pool);
+        drift = 0.5 * (weights[k] + (k + 1 < count ? weights[k + 1] : 0.0)) * dt;
+    }
+    positionDrift(bodies, drift, pool);
+}
+
+void integratorStep(entt::registry &registry, BodyArrays &bodies, double dt, Integrator integrator, ThreadPool *pool) {
+    constexpr double kLeapfrog[] = { 1.0 };
+    switch (integrator) {
+        case Integrator::Leapfrog: composedStep(registry, bodies, dt, kLeapfrog, 1, pool); break;
+        case Integrator::Yoshida4: composedStep(registry, bodies, dt, kYoshida4, 3, pool); break;
+        case Integrator::Yoshida6: composedStep(registry, bodies, dt, kYoshida6, 7, pool); break;
+        default:
+            momentumKick(registry, bodies, dt, pool);
+            positionDrift(bodies, dt, pool);
+            break;
+    }
+}
+
+// Z(a, b) of Wisdom, Holman & Touma (1996)
+void correctorStage(entt::registry &registry, BodyArrays &bodies, double a, double b, ThreadPool *pool) {
+    positionDrift(bodies, a, pool);
+    calculateAbsoluteStates(bodies);
+    momentumKick(registry, bodies, -b, pool);
+    positionDrift(bodies, -2.0 * a, pool);
+    calculateAbsoluteStates(bodies);
+    momentumKick(registry, bodies, b, pool);
+    positionDrift(bodies, a, pool);
+}
+
+// Maps real states to mapped ones for direction 1, and back for direction -1
+void applyCorrector(entt::registry &registry, BodyArrays &bodies, int order, double dt, double direction, ThreadPool *pool) {
+    const double *b = order == 7 ? kCorrector7 : order == 5 ? kCorrector5 : kCorrector3;
+    int stages = (order - 1) / 2;
+    for (int k = stages; k >= 1; k--) correctorStage(registry, bodies, -k * kCorrectorDrift * dt, -direction * b[k - 1] * dt, pool);
+    for (int k = 1; k <= stages; k++) correctorStage(registry, bodies, k * kCorrectorDrift * dt, direction * b[k - 1] * dt, pool);
+    calculateAbsoluteStates(bodies);
+}
 
-        state.st.pos += dt * state.st.vel;
+// Leaves the mapped states for `order` and `dt` in the arrays, starting from the real
+// states the registry holds, or from the corrected ones if mapped for something else
+void mapStates(entt::registry &registry, BodyArrays &bodies, int order, double dt, ThreadPool *pool) {
+    if (bodies.mappedCorrectorOrder == order && (order == 0 || bodies.mappedStep == dt)) return;
+    if (bodies.mappedCorrectorOrder != 0) {
+        bodies.x = bodies.ox, bodies.y = bodies.oy, bodies.z = bodies.oz;
+        bodies.vx = bodies.ovx, bodies.vy = bodies.ovy, bodies.vz = bodies.ovz;
+        std::fill(bodies.perturbed.begin(), bodies.perturbed.end(), 1);
+        calculateAbsoluteStates(bodies);
     }
+    if (order != 0) applyCorrector(registry, bodies, order, dt, 1.0, pool);
+    bodies.mappedCorrectorOrder = order;
+    bodies.mappedStep = dt;
 }
 
-void keplerDrift(entt::registry &registry, double dt) {
-    recalculateAllKeplerParameters(registry);
-    keplerPropagationSystem(registry, dt);
+// Corrects a copy of the mapped states into the output states and the absolute state
+// cache, leaving the mapped states in place for the next step
+void correctStates(entt::registry &registry, BodyArrays &bodies, ThreadPool *pool) {
+    auto &corrected = registry.ctx().emplace<CorrectedBodyArrays>().bodies;
+    corrected = bodies;
+    applyCorrector(registry, corrected, bodies.mappedCorrectorOrder, bodies.mappedStep, -1.0, pool);
+    bodies.ox = corrected.x, bodies.oy = corrected.y, bodies.oz = corrected.z;
+    bodies.ovx = corrected.vx, bodies.ovy = corrected.vy, bodies.ovz = corrected.vz;
+    bodies.ax = corrected.ax, bodies.ay = corrected.ay, bodies.az = corrected.az;
+    bodies.avx = corrected.avx, bodies.avy = corrected.avy, bodies.avz = corrected.avz;
 }
 
-void positionDrift(entt::registry &registry, double dt) {
-    linearDriftRootBodies(registry, dt);
-    keplerDrift(registry, dt);
+// Fills the test particles' accelerations for the current absolute states, unless the
+// ones from the end of the last step were computed for the same bodies
+void accelerateTestParticles(entt::registry &registry, BodyArrays &bodies, TestParticleArrays &particles, ThreadPool *pool) {
+    if (particles.accelerationsValid && particles.sourceX == bodies.ax && particles.sourceY == bodies.ay && particles.sourceZ == bodies.az &&
+        particles.sourceM == bodies.m) {
+        return;
+    }
+    std::fill(particles.gx.begin(), particles.gx.end(), 0.0);
+    std::fill(particles.gy.begin(), particles.gy.end(), 0.0);
+    std::fill(particles.gz.begin(), particles.gz.end(), 0.0);
+    accumulateTestParticleGravity(bodies, particles, bestGravityKernel(), pool);
+    particles.sourceX = bodies.ax, particles.sourceY = bodies.ay, particles.sourceZ = bodies.az;
+    particles.sourceM = bodies.m;
+    particles.accelerationsValid = true;
+    registry.ctx().emplace<PhysicsStatistics>().particleForceEvaluations += particles.size();
+}
+
+void kickTestParticles(TestParticleArrays &particles, double dt, ThreadPool *pool) {
+    double scale = kGravitationalConstant * dt;
+    parallelFor(pool, 0, particles.size(), kBodyGrain, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) {
+            double dvx = scale * particles.gx[i], dvy = scale * particles.gy[i], dvz = scale * particles.gz[i];
+            if (dvx != 0.0 || dvy != 0.0 || dvz != 0.0) particles.perturbed[i] = 1;
+            particles.vx[i] += dvx;
+            particles.vy[i] += dvy;
+            particles.vz[i] += dvz;
+        }
+    });
+}
+
+void driftTestParticles(TestParticleArrays &particles, const BodyArrays &bodies, double dt, ThreadPool *pool) {
+    for (size_t i = 0; i < particles.size(); i++) {
+        double scale = particles.primary[i] < 0 ? dt : 0.0;
+        particles.x[i] += scale * particles.vx[i];
+        particles.y[i] += scale * particles.vy[i];
+        particles.z[i] += scale * particles.vz[i];
+    }
+    recalculatePerturbedKeplerParameters(particles, bodies, pool);
+    keplerPropagationSystem(particles, dt, pool);
+}
+
+// Splits dt into 2^k sub-steps for the deepest level k in use. At each sub-step, the
+// bodies due for a kick are kicked by their own step, then every body drifts by one
+// sub-step so that the next forces see current positions. Levels only change at the
+// start of a base step, where every body is synchronized.
+void blockTimestepUpdate(entt::registry &registry, BodyArrays &bodies, double dt, ThreadPool *pool) {
+    const auto &settings = registry.ctx().emplace<PhysicsSettings>();
+    int deepest = assignTimestepLevels(bodies, dt, settings.maxTimestepLevel, settings.stepsPerOrbit);
+    size_t subSteps = size_t{ 1 } << deepest;
+    double h = std::ldexp(dt, -deepest);
+    for (size_t s = 0; s < subSteps; s++) {
+        // The gather already filled the absolute states for the first sub-step
+        if (s > 0) calculateAbsoluteStates(bodies);
+        collectActiveBodies(bodies, deepest, s, bodies.active);
+        blockMomentumKick(registry, bodies, dt, pool);
+        positionDrift(bodies, h, pool);
+    }
+    registry.ctx().emplace<PhysicsStatistics>().subSteps += subSteps;
 }
 
 } // namespace
 
 void physicsUpdate(entt::registry &registry, double dt) {
-    // Kick-drift-kick integrator
-    // Note: For now, there is no need to do half-kicks since none of the forces
-    // depend on velocity, so full kicks are algebraically equivalent.
-    momentumKick(registry, dt);
-    positionDrift(registry, dt);
+    // Maps to the SoA arrays, steps bodies with the chosen integrator and test particles with KDK, then scatters back
+    auto *pool = getPhysicsThreadPool(registry);
+    auto &bodies = gatherBodyArrays(registry);
+    auto &particles = gatherTestParticles(registry, bodies);
+    const auto settings = registry.ctx().emplace<PhysicsSettings>();
+    int correctorOrder = !settings.blockTimesteps && settings.integrator == Integrator::Leapfrog ? settings.correctorOrder : 0;
+
+    // Test particles are kicked against the real states at either end of the step, so
+    // this comes before the bodies are mapped
+    if (particles.size() > 0) {
+        accelerateTestParticles(registry, bodies, particles, pool);
+        kickTestParticles(particles, 0.5 * dt, pool);
+    }
+    mapStates(registry, bodies, correctorOrder, dt, pool);
+
+    if (settings.blockTimesteps) {
+        blockTimestepUpdate(registry, bodies, dt, pool);
+    } else {
+        integratorStep(registry, bodies, dt, settings.integrator, pool);
+        registry.ctx().emplace<PhysicsStatistics>().subSteps++;
+    }
+    registry.ctx().emplace<PhysicsStatistics>().steps++;
+
+    if (correctorOrder != 0) {
+        correctStates(registry, bodies, pool);
+    } else {
+        calculateAbsoluteStates(bodies);
+    }
+
+    if (particles.size() > 0) {
+        driftTestParticles(particles, bodies, dt, pool);
+        calculateAbsoluteStates(particles, bodies);
+        accelerateTestParticles(registry, bodies, particles, pool);
+        kickTestParticles(particles, 0.5 * dt, pool);
+        calculateAbsoluteStates(particles, bodies);
+    }
+    scatterBodyArrays(registry, bodies);
+    scatterTestParticles(registry, particles);
+
+    // Leaves the arrays as they are; the next gather picks up the new hierarchy
+    if (settings.primarySwitching) registry.ctx().emplace<PhysicsStatistics>().primarySwitches += switchPrimaries(registry, bodies, particles, pool);
 }
 
 void calculateConservedQuantities(entt::registry &registry, Eigen::Vector3d &com, double &energy, Eigen::Vector3d &momentum, Eigen::Vector3d &angularMomentum) {
+    const auto &bodies = getBodyArrays(registry);
+
     com = Eigen::Vector3d::Zero();
     double totalMass = 0.0;
-    auto view = registry.view<BodyState, Body>();
-    for (auto entity : view) {
-        auto &state = view.get<BodyState>(entity);
-        auto &body = view.get<Body>(entity);
-        totalMass += body.mass;
-        com += body.mass * calculateAbsolutePosition(registry, state);
+    for (size_t i = 0; i < bodies.size(); i++) {
+        totalMass += bodies.m[i];
+        com += bodies.m[i] * Eigen::Vector3d(bodies.ax[i], bodies.ay[i], bodies.az[i]);
     }
     com /= totalMass;
 
     energy = 0.0;
     momentum = Eigen::Vector3d::Zero();
     angularMomentum = Eigen::Vector3d::Zero();
-    for (auto it1 = view.begin(); it1 != view.end(); ++it1) {
-        auto entity1 = *it1;
-        auto &state1 = view.get<BodyState>(entity1);
-        auto &body1 = view.get<Body>(entity1);
-
-        Eigen::Vector3d pos = calculateAbsolutePosition(registry, state1);
-        Eigen::Vector3d vel = calculateAbsoluteVelocity(registry, state1);
+    for (size_t i = 0; i < bodies.size(); i++) {
+        Eigen::Vector3d pos(bodies.ax[i], bodies.ay[i], bodies.az[i]);
+        Eigen::Vector3d vel(bodies.avx[i], bodies.avy[i], bodies.avz[i]);
 
         // Kinetic energy and momentum
-        energy += 0.5 * body1.mass * vel.squaredNorm();
-        momentum += body1.mass * vel;
-        angularMomentum += body1.mass * pos.cross(vel);
+        energy += 0.5 * bodies.m[i] * vel.squaredNorm();
+        momentum += bodies.m[i] * vel;
+        angularMomentum += bodies.m[i] * pos.cross(vel);
 
         // Potential energy
-        for (auto it2 = std::next(it1); it2 != view.end(); ++it2) {
-            auto entity2 = *it2;
-            auto &state2 = view.get<BodyState>(entity2);
-            auto &body2 = view.get<Body>(entity2);
-
-            Eigen::Vector3d r = calculateAbsolutePosition(registry, state2) - pos;
-            double norm = r.norm();
-            energy -= kGravitationalConstant * body1.mass * body2.mass / norm;
+        double potential = 0.0;
+        for (size_t j = i + 1; j < bodies.size(); j++) {
+            double rx = bodies.ax[j] - pos.x(), ry = bodies.ay[j] - pos.y(), rz = bodies.az[j] - pos.z();
+            potential += bodies.m[j] / std::sqrt(rx * rx + ry * ry + rz * rz);
         }
+        energy -= kGravitationalConstant * bodies.m[i] * potential;
     }
 }
 
@@ -1,10 +1,16 @@
 #pragma once
 
+#include <cstdint>
+
 #include <Eigen/Dense>
 #include <entt/entt.hpp>
 
 namespace sfs::physics {
 
+struct BodyArrays;
+class ThreadPool;
+enum class GravityKernel;
+
 constexpr double kGravitationalConstant = 6.67430e-11;
 
 struct PhysicsState {
@@ -23,20 +29,80 @@ struct Body {
 
 struct BodyState { PhysicsState st; };
 
+// Tags a body as a massless test particle. Test particles feel the gravity of every
+// massive body outside their primary chain but pull on nothing, so each costs
+// O(massive bodies) per step instead of O(bodies). They are kept out of BodyArrays, in
+// TestParticleArrays, and their Body mass only serves bookkeeping.
+//
+// Test particles take a second-order kick-drift-kick step of the full dt, whatever the
+// integrator settings, with Kepler drift about their primary.
+struct TestParticle { };
+
+enum class GravityMode {
+    Direct,     // Exact sum over all pairs
+    BarnesHut,  // Octree approximation, for large asteroid populations
+};
+
+// Splitting of each step into momentum kicks and Kepler drifts
+enum class Integrator {
+    KickDrift,  // First-order kick then drift
+    Leapfrog,   // Second-order drift-kick-drift, the Wisdom-Holman map
+    Yoshida4,   // Fourth-order composition of three leapfrog steps
+    Yoshida6,   // Sixth-order composition of seven leapfrog steps
+};
+
+// Simulation settings, stored in the registry context. Defaults are used if the
+// registry has none.
+struct PhysicsSettings {
+    GravityMode gravityMode = GravityMode::Direct;
+    double openingAngle = 0.5;  // Barnes-Hut theta
+    unsigned threadCount = 1;   // Worker threads for the per-body systems, 0 for one per hardware thread
+
+    Integrator integrator = Integrator::KickDrift;
+    // Wisdom-Holman symplectic corrector for the leapfrog integrator: 0 (off), 3, 5 or 7.
+    // The integrator then advances mapped states, and each physicsUpdate pays for one
+    // corrector application, 2 force evaluations per order above 1, to output real ones.
+    int correctorOrder = 0;
+
+    // Block timesteps: each body is kicked every dt / 2^k for its own level k, and forces
+    // are only evaluated for the bodies due at each sub-step. See assignTimestepLevels.
+    // Block timesteps always use the kick-drift split, without corrector.
+    bool blockTimesteps = false;
+    int maxTimestepLevel = 8;
+    double stepsPerOrbit = 200.0;
+
+    // Reassigns primaries by sphere of influence after each step, see switchPrimaries
+    bool primarySwitching = true;
+};
+
+// Running totals of the work done by physicsUpdate, stored in the registry context
+struct PhysicsStatistics {
+    uint64_t steps = 0;
+    uint64_t subSteps = 0;
+    uint64_t forceEvaluations = 0;  // Bodies whose force was evaluated, summed over sub-steps
+    uint64_t particleForceEvaluations = 0;
+    uint64_t primarySwitches = 0;  // Bodies and test particles reparented
+};
+
+// Thread pool matching the registry's settings, created on first use and whenever the
+// thread count changes. Null when running single-threaded.
+ThreadPool *getPhysicsThreadPool(entt::registry &registry);
+
 void physicsUpdate(entt::registry &registry, double dt);
 
-void calculateConservedQuantities(entt::registry &registry, Eigen::Vector3d &com, double &energy, Eigen::Vector3d &momentum, Eigen::Vector3d &angularMomentum);
+// Accumulates pairwise gravity into every body's ForceAccumulator, using the registry's
+// gravity mode
+void gravitySystem(entt::registry &registry);
+// NB: The BodyArrays overloads read the absolute position cache, which must be up to date
+void gravitySystem(BodyArrays &bodies, ThreadPool *pool = nullptr);
+void gravitySystem(BodyArrays &bodies, GravityKernel kernel, ThreadPool *pool = nullptr);
 
-template<typename T>
-bool isParentBody(entt::registry &registry, entt::entity child, entt::entity parent) {
-    while (child != entt::null) {
-        const auto &state = registry.get<T>(child);
-        if (state.st.primary == parent) return true;
-        child = state.st.primary;
-    }
-    return false;
-}
+// Uses the absolute state cache from the last physics step. Test particles are left
+// out, since they carry no potential energy.
+void calculateConservedQuantities(entt::registry &registry, Eigen::Vector3d &com, double &energy, Eigen::Vector3d &momentum, Eigen::Vector3d &angularMomentum);
 
+// NB: The helpers below walk the primary chain and are meant for scene construction.
+// During simulation, read absolute states from getBodyArrays() instead.
 template<typename T>
 Eigen::Vector3d calculateAbsolutePosition(entt::registry &registry, const T &state) {
     Eigen::Vector3d pos = state.st.pos;
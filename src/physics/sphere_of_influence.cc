@@ -0,0 +1,250 @@
+#include "sphere_of_influence.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "physics/body_arrays.h"
+#include "physics/kepler.h"
+#include "physics/parallel.h"
+#include "physics/physics.h"
+#include "physics/test_particles.h"
+
+namespace sfs::physics {
+
+namespace {
+
+constexpr size_t kQueryGrain = 1024;  // Bodies per parallel chunk
+constexpr size_t kSparseLevel = 16;   // Levels with at most this many spheres are scanned, not hashed
+
+// One level of the grid, holding the spheres whose diameter fits in a cell. Each sphere
+// is listed under every cell it overlaps, at most 2 per axis, so a point only needs the
+// spheres listed under its own cell. Cells are hashed into 2^bits slots in CSR form;
+// colliding cells only cost a few extra distance checks.
+struct GridLevel {
+    double cellSize = 0.0;
+    int bits = 0;  // 0 for a sparse level, whose spheres all sit in slot 0
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> entries;
+};
+
+struct SphereOfInfluenceGrid {
+    std::vector<double> radius;       // Of every body
+    // (m / M)^(2/5) of every body for the masses it was computed from, since pow costs
+    // more than the rest of the radius
+    std::vector<double> massRatio, ratioPower;
+    std::vector<GridLevel> levels;    // By increasing cell size
+    std::vector<std::pair<int, uint32_t>> byExponent;
+    std::vector<uint32_t> cursor;
+    std::vector<int32_t> bodyPrimary, particlePrimary;
+};
+
+int64_t cellCoordinate(double x, double cellSize) {
+    // Clamped so that far away points cannot overflow; they merely share cells
+    return static_cast<int64_t>(std::clamp(std::floor(x / cellSize), -0x1p62, 0x1p62));
+}
+
+size_t slotOf(const GridLevel &level, int64_t ix, int64_t iy, int64_t iz) {
+    if (level.bits == 0) return 0;
+    uint64_t key = static_cast<uint64_t>(ix) * 0x9E3779B97F4A7C15ull ^ static_cast<uint64_t>(iy) * 0xC2B2AE3D27D4EB4Full ^
+                   static_cast<uint64_t>(iz) * 0x165667B19E3779F9ull;
+    return static_cast<size_t>(key >> (64 - level.bits));
+}
+
+template<typename Fn>
+void forEachSlot(const BodyArrays &bodies, const GridLevel &level, double r, uint32_t s, Fn &&fn) {
+    if (level.bits == 0) {
+        fn(size_t{ 0 });
+        return;
+    }
+    int64_t x0 = cellCoordinate(bodies.ax[s] - r, level.cellSize), x1 = cellCoordinate(bodies.ax[s] + r, level.cellSize);
+    int64_t y0 = cellCoordinate(bodies.ay[s] - r, level.cellSize), y1 = cellCoordinate(bodies.ay[s] + r, level.cellSize);
+    int64_t z0 = cellCoordinate(bodies.az[s] - r, level.cellSize), z1 = cellCoordinate(bodies.az[s] + r, level.cellSize);
+    for (int64_t ix = x0; ix <= x1; ix++) {
+        for (int64_t iy = y0; iy <= y1; iy++) {
+            for (int64_t iz = z0; iz <= z1; iz++) fn(slotOf(level, ix, iy, iz));
+        }
+    }
+}
+
+// Counting sort of the spheres [first, last) of grid.byExponent into their slots
+void buildLevel(const BodyArrays &bodies, SphereOfInfluenceGrid &grid, size_t first, size_t last, GridLevel &level) {
+    size_t count = last - first;
+    level.cellSize = std::ldexp(1.0, grid.byExponent[first].first);
+    level.bits = 0;
+    // About 8 cells per sphere, at a load factor of 1/2
+    if (count > kSparseLevel) {
+        while ((size_t{ 1 } << level.bits) < 16 * count) level.bits++;
+    }
+    size_t slots = size_t{ 1 } << level.bits;
+
+    level.offsets.assign(slots + 1, 0);
+    for (size_t k = first; k < last; k++) {
+        uint32_t s = grid.byExponent[k].second;
+        forEachSlot(bodies, level, grid.radius[s], s, [&](size_t slot) { level.offsets[slot + 1]++; });
+    }
+    for (size_t slot = 0; slot < slots; slot++) level.offsets[slot + 1] += level.offsets[slot];
+
+    // NB: A sphere whose cells share a slot is listed twice, which is harmless
+    level.entries.resize(level.offsets[slots]);
+    grid.cursor.assign(level.offsets.begin(), level.offsets.end() - 1);
+    for (size_t k = first; k < last; k++) {
+        uint32_t s = grid.byExponent[k].second;
+        forEachSlot(bodies, level, grid.radius[s], s, [&](size_t slot) { level.entries[grid.cursor[slot]++] = s; });
+    }
+}
+
+double distanceSquared(const BodyArrays &bodies, int32_t i, double x, double y, double z) {
+    double dx = x - bodies.ax[i], dy = y - bodies.ay[i], dz = z - bodies.az[i];
+    return dx * dx + dy * dy + dz * dz;
+}
+
+void buildGrid(const BodyArrays &bodies, SphereOfInfluenceGrid &grid) {
+    grid.radius.resize(bodies.size());
+    grid.massRatio.resize(bodies.size(), 0.0);
+    grid.ratioPower.resize(bodies.size(), 0.0);
+    grid.byExponent.clear();
+    for (size_t i = 0; i < bodies.size(); i++) {
+        int32_t p = bodies.primary[i];
+        grid.radius[i] = p < 0 ? std::numeric_limits<double>::infinity() : 0.0;
+        if (p < 0 || !(bodies.m[i] > 0.0) || !(bodies.m[p] > 0.0)) continue;
+        double ratio = bodies.m[i] / bodies.m[p];
+        if (grid.massRatio[i] != ratio) grid.massRatio[i] = ratio, grid.ratioPower[i] = std::pow(ratio, 0.4);
+        double r = std::sqrt(distanceSquared(bodies, p, bodies.ax[i], bodies.ay[i], bodies.az[i])) * grid.ratioPower[i];
+        grid.radius[i] = r;
+        if (!(r > 0.0)) continue;
+        // The cell size is the smallest power of 4 at least the diameter, 2r <= 2^e
+        int e;
+        std::frexp(2.0 * r, &e);
+        e += e & 1;
+        grid.byExponent.emplace_back(e, static_cast<uint32_t>(i));
+    }
+    std::sort(grid.byExponent.begin(), grid.byExponent.end());
+
+    size_t levelCount = 0;
+    for (size_t first = 0; first < grid.byExponent.size();) {
+        size_t last = first;
+        while (last < grid.byExponent.size() && grid.byExponent[last].first == grid.byExponent[first].first) last++;
+        if (grid.levels.size() <= levelCount) grid.levels.emplace_back();
+        buildLevel(bodies, grid, first, last, grid.levels[levelCount++]);
+        first = last;
+    }
+    grid.levels.resize(levelCount);
+}
+
+bool isDescendant(const BodyArrays &bodies, int32_t i, int32_t ancestor) {
+    for (int32_t cur = bodies.primary[i]; cur >= 0; cur = bodies.primary[cur]) {
+        if (cur == ancestor) return true;
+    }
+    return false;
+}
+
+// Whether a body of `mass` at (x, y, z) moving at (vx, vy, vz) has a negative two-body
+// energy relative to body s
+bool isBound(const BodyArrays &bodies, int32_t s, double mass, double x, double y, double z, double vx, double vy, double vz) {
+    double dvx = vx - bodies.avx[s], dvy = vy - bodies.avy[s], dvz = vz - bodies.avz[s];
+    double r = std::sqrt(distanceSquared(bodies, s, x, y, z));
+    return 0.5 * (dvx * dvx + dvy * dvy + dvz * dvz) * r < kGravitationalConstant * (bodies.m[s] + mass);
+}
+
+// Primary for a body of `mass` at (x, y, z) moving at (vx, vy, vz), currently orbiting
+// `primary`. `self` is the body's index, or -1 for test particles. A new primary must be
+// much heavier than the body and hold it on a bound orbit; a Kepler arc about anything
+// else is strongly hyperbolic and ill-conditioned over long steps.
+int32_t choosePrimary(const BodyArrays &bodies, const SphereOfInfluenceGrid &grid, int32_t self, int32_t primary, double mass, double x, double y,
+                      double z, double vx, double vy, double vz) {
+    int32_t best = -1;
+    double bestRadius = std::numeric_limits<double>::infinity();
+    if (bodies.primary[primary] >= 0) {
+        double r = grid.radius[primary];
+        if (distanceSquared(bodies, primary, x, y, z) < kSphereOfInfluenceExit * kSphereOfInfluenceExit * r * r) best = primary, bestRadius = r;
+    }
+
+    for (const auto &level : grid.levels) {
+        // Radii in this level and the later ones are at least an eighth of its cell size
+        if (level.cellSize / 8 >= bestRadius) break;
+        size_t slot = slotOf(level, cellCoordinate(x, level.cellSize), cellCoordinate(y, level.cellSize), cellCoordinate(z, level.cellSize));
+        for (uint32_t k = level.offsets[slot]; k < level.offsets[slot + 1]; k++) {
+            auto s = static_cast<int32_t>(level.entries[k]);
+            double r = grid.radius[s];
+            if (r >= bestRadius || s == self || !(bodies.m[s] > kPrimaryMassRatio * mass)) continue;
+            if (distanceSquared(bodies, s, x, y, z) >= r * r) continue;
+            if (self >= 0 && isDescendant(bodies, s, self)) continue;
+            if (s != primary && !isBound(bodies, s, mass, x, y, z, vx, vy, vz)) continue;
+            best = s, bestRadius = r;
+        }
+    }
+    if (best >= 0) return best;
+
+    int32_t root = primary;
+    while (bodies.primary[root] >= 0) root = bodies.primary[root];
+    return root;
+}
+
+bool isAncestor(entt::registry &registry, entt::entity ancestor, entt::entity entity) {
+    for (auto cur = entity; cur != entt::null; cur = registry.get<BodyState>(cur).st.primary) {
+        if (cur == ancestor) return true;
+    }
+    return false;
+}
+
+void rebase(entt::registry &registry, entt::entity entity, entt::entity primary, const Eigen::Vector3d &position, const Eigen::Vector3d &velocity,
+            double primaryMass) {
+    auto &state = registry.get<BodyState>(entity);
+    state.st.primary = primary;
+    state.st.pos = position;
+    state.st.vel = velocity;
+    if (auto *kepler = registry.try_get<KeplerParameters>(entity)) {
+        *kepler = calculateKeplerParameters(position, velocity, kGravitationalConstant * primaryMass);
+        registry.get_or_emplace<KeplerSolverState>(entity) = KeplerSolverState{};
+    }
+}
+
+} // namespace
+
+size_t switchPrimaries(entt::registry &registry, const BodyArrays &bodies, const TestParticleArrays &particles, ThreadPool *pool) {
+    auto &grid = registry.ctx().emplace<SphereOfInfluenceGrid>();
+    buildGrid(bodies, grid);
+
+    grid.bodyPrimary.resize(bodies.size());
+    parallelFor(pool, 0, bodies.size(), kQueryGrain, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) {
+            int32_t p = bodies.primary[i];
+            grid.bodyPrimary[i] = p < 0 ? p : choosePrimary(bodies, grid, static_cast<int32_t>(i), p, bodies.m[i], bodies.ax[i], bodies.ay[i], bodies.az[i],
+                                                                  bodies.avx[i], bodies.avy[i], bodies.avz[i]);
+        }
+    });
+    grid.particlePrimary.resize(particles.size());
+    parallelFor(pool, 0, particles.size(), kQueryGrain, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) {
+            int32_t p = particles.primary[i];
+            grid.particlePrimary[i] = p < 0 ? p : choosePrimary(bodies, grid, -1, p, 0.0, particles.ax[i], particles.ay[i], particles.az[i], particles.avx[i],
+                                                                      particles.avy[i], particles.avz[i]);
+        }
+    });
+
+    size_t switched = 0;
+    for (size_t i = 0; i < bodies.size(); i++) {
+        int32_t p = grid.bodyPrimary[i];
+        if (p == bodies.primary[i]) continue;
+        // An earlier switch in this pass may have moved the new primary under this body
+        if (isAncestor(registry, bodies.entity[i], bodies.entity[p])) continue;
+        Eigen::Vector3d position(bodies.ax[i] - bodies.ax[p], bodies.ay[i] - bodies.ay[p], bodies.az[i] - bodies.az[p]);
+        Eigen::Vector3d velocity(bodies.avx[i] - bodies.avx[p], bodies.avy[i] - bodies.avy[p], bodies.avz[i] - bodies.avz[p]);
+        rebase(registry, bodies.entity[i], bodies.entity[p], position, velocity, bodies.m[p]);
+        switched++;
+    }
+    for (size_t i = 0; i < particles.size(); i++) {
+        int32_t p = grid.particlePrimary[i];
+        if (p == particles.primary[i]) continue;
+        Eigen::Vector3d position(particles.ax[i] - bodies.ax[p], particles.ay[i] - bodies.ay[p], particles.az[i] - bodies.az[p]);
+        Eigen::Vector3d velocity(particles.avx[i] - bodies.avx[p], particles.avy[i] - bodies.avy[p], particles.avz[i] - bodies.avz[p]);
+        rebase(registry, particles.entity[i], bodies.entity[p], position, velocity, bodies.m[p]);
+        switched++;
+    }
+    return switched;
+}
+
+} // namespace sfs::physics
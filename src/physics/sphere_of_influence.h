@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+
+#include <entt/entt.hpp>
+
+namespace sfs::physics {
+
+struct BodyArrays;
+struct TestParticleArrays;
+class ThreadPool;
+
+// How far past its primary's sphere of influence a body has to be to leave it, as a
+// multiple of the radius, so that it does not switch back and forth on the boundary
+constexpr double kSphereOfInfluenceExit = 1.05;
+
+// How much more massive than a body its new primary has to be, so that comparable bodies
+// passing each other are not made satellite and primary
+constexpr double kPrimaryMassRatio = 10.0;
+
+// Moves every body and test particle that has a primary to the body with the smallest
+// sphere of influence containing it, or to the root of its hierarchy if there is none.
+// A new primary must be more than kPrimaryMassRatio times as massive and hold the body
+// on a bound two-body orbit. The sphere of influence of a body at distance r from its
+// primary is the Laplace one, of radius r (m / M)^(2/5) for masses m and M. Root bodies
+// have an infinite one.
+//
+// The spheres are kept in a hierarchical grid with one level per power of 4 of radius,
+// and each body only looks at the spheres in its own cell of every level. Reparented
+// entities are rebased onto their new primary in the registry, with fresh Kepler
+// parameters; the next gather then rebuilds the body layout and marks them perturbed.
+// Returns the number of entities reparented.
+//
+// NB: Reads the absolute state caches, which must match the registry
+size_t switchPrimaries(entt::registry &registry, const BodyArrays &bodies, const TestParticleArrays &particles, ThreadPool *pool = nullptr);
+
+} // namespace sfs::physics
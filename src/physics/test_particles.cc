@@ -0,0 +1,127 @@
+#include "test_particles.h"
+
+#include <algorithm>
+#include <tuple>
+
+#include "physics/body_arrays.h"
+#include "physics/physics.h"
+
+namespace sfs::physics {
+
+namespace {
+
+bool layoutMatches(entt::registry &registry, const TestParticleArrays &particles, size_t count) {
+    if (particles.size() != count) return false;
+    for (auto entity : particles.entity) {
+        if (!registry.valid(entity) || !registry.all_of<TestParticle, BodyState, Body, KeplerParameters, KeplerSolverState>(entity)) return false;
+    }
+    return true;
+}
+
+void rebuildLayout(entt::registry &registry, TestParticleArrays &particles) {
+    std::vector<std::tuple<uint32_t, uint32_t, entt::entity>> keys;
+    auto view = registry.view<TestParticle, BodyState, Body, KeplerParameters>();
+    for (auto entity : view) {
+        auto primary = view.get<BodyState>(entity).st.primary;
+        uint32_t primaryId = primary == entt::null ? 0 : static_cast<uint32_t>(entt::to_entity(primary));
+        keys.emplace_back(primaryId, static_cast<uint32_t>(entt::to_entity(entity)), entity);
+    }
+    std::sort(keys.begin(), keys.end());
+
+    particles.resize(keys.size());
+    particles.accelerationsValid = false;
+    particles.indexOf.clear();
+    for (size_t i = 0; i < keys.size(); i++) {
+        auto entity = std::get<2>(keys[i]);
+        auto id = entt::to_entity(entity);
+        if (particles.indexOf.size() <= id) particles.indexOf.resize(id + 1, -1);
+        particles.indexOf[id] = static_cast<int32_t>(i);
+        particles.entity[i] = entity;
+        particles.perturbed[i] = 1;
+        registry.get_or_emplace<KeplerSolverState>(entity);
+    }
+}
+
+} // namespace
+
+void TestParticleArrays::resize(size_t n) {
+    entity.resize(n);
+    primary.resize(n);
+    x.resize(n), y.resize(n), z.resize(n);
+    vx.resize(n), vy.resize(n), vz.resize(n);
+    gx.resize(n), gy.resize(n), gz.resize(n);
+    kepler.resize(n);
+    solver.resize(n);
+    perturbed.resize(n);
+    ax.resize(n), ay.resize(n), az.resize(n);
+    avx.resize(n), avy.resize(n), avz.resize(n);
+}
+
+TestParticleArrays &gatherTestParticles(entt::registry &registry, const BodyArrays &bodies) {
+    auto &particles = registry.ctx().emplace<TestParticleArrays>();
+
+    size_t count = 0;
+    for (auto entity : registry.view<TestParticle, BodyState, Body, KeplerParameters>()) {
+        (void) entity;
+        count++;
+    }
+    if (!layoutMatches(registry, particles, count)) rebuildLayout(registry, particles);
+
+    for (size_t i = 0; i < particles.size(); i++) {
+        auto entity = particles.entity[i];
+        const auto &state = registry.get<BodyState>(entity);
+        // The arrays still hold what the last step scattered, so any difference was
+        // written by someone else
+        if (state.st.pos != Eigen::Vector3d(particles.x[i], particles.y[i], particles.z[i]) ||
+            state.st.vel != Eigen::Vector3d(particles.vx[i], particles.vy[i], particles.vz[i])) {
+            particles.perturbed[i] = 1;
+            particles.accelerationsValid = false;
+        }
+        particles.x[i] = state.st.pos.x(), particles.y[i] = state.st.pos.y(), particles.z[i] = state.st.pos.z();
+        particles.vx[i] = state.st.vel.x(), particles.vy[i] = state.st.vel.y(), particles.vz[i] = state.st.vel.z();
+
+        // NB: A primary that is itself a test particle, or not a body, is treated as none
+        auto primary = state.st.primary;
+        int32_t index = -1;
+        if (primary != entt::null && entt::to_entity(primary) < bodies.indexOf.size()) index = bodies.indexOf[entt::to_entity(primary)];
+        if (index >= 0 && bodies.entity[index] != primary) index = -1;
+        if (particles.primary[i] != index) particles.accelerationsValid = false;
+        particles.primary[i] = index;
+
+        particles.kepler[i] = registry.get<KeplerParameters>(entity);
+        particles.solver[i] = registry.get<KeplerSolverState>(entity);
+    }
+    calculateAbsoluteStates(particles, bodies);
+    return particles;
+}
+
+const TestParticleArrays &getTestParticleArrays(entt::registry &registry) {
+    if (auto *particles = registry.ctx().find<TestParticleArrays>()) return *particles;
+    return gatherTestParticles(registry, getBodyArrays(registry));
+}
+
+void calculateAbsoluteStates(TestParticleArrays &particles, const BodyArrays &bodies) {
+    for (size_t i = 0; i < particles.size(); i++) {
+        int32_t p = particles.primary[i];
+        double px = 0.0, py = 0.0, pz = 0.0, pvx = 0.0, pvy = 0.0, pvz = 0.0;
+        if (p >= 0) {
+            px = bodies.ax[p], py = bodies.ay[p], pz = bodies.az[p];
+            pvx = bodies.avx[p], pvy = bodies.avy[p], pvz = bodies.avz[p];
+        }
+        particles.ax[i] = px + particles.x[i], particles.ay[i] = py + particles.y[i], particles.az[i] = pz + particles.z[i];
+        particles.avx[i] = pvx + particles.vx[i], particles.avy[i] = pvy + particles.vy[i], particles.avz[i] = pvz + particles.vz[i];
+    }
+}
+
+void scatterTestParticles(entt::registry &registry, const TestParticleArrays &particles) {
+    for (size_t i = 0; i < particles.size(); i++) {
+        auto entity = particles.entity[i];
+        auto &state = registry.get<BodyState>(entity);
+        state.st.pos = Eigen::Vector3d(particles.x[i], particles.y[i], particles.z[i]);
+        state.st.vel = Eigen::Vector3d(particles.vx[i], particles.vy[i], particles.vz[i]);
+        registry.get<KeplerParameters>(entity) = particles.kepler[i];
+        registry.get<KeplerSolverState>(entity) = particles.solver[i];
+    }
+}
+
+} // namespace sfs::physics
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <entt/entt.hpp>
+
+#include "physics/kepler.h"
+
+namespace sfs::physics {
+
+struct BodyArrays;
+
+// Packed structure-of-arrays mirror of every entity with TestParticle, BodyState, Body
+// and KeplerParameters, the counterpart of BodyArrays for massless bodies. Particles
+// are ordered by primary, then entity, so that particles sharing a primary sit together.
+//
+// Like BodyArrays, the arrays are gathered at the start of physicsUpdate and scattered
+// back at the end.
+struct TestParticleArrays {
+    std::vector<entt::entity> entity;
+    std::vector<int32_t> primary;  // Index of the primary in BodyArrays, or -1
+
+    // State relative to the primary
+    std::vector<double> x, y, z;
+    std::vector<double> vx, vy, vz;
+    std::vector<double> gx, gy, gz;  // Acceleration divided by G
+
+    std::vector<KeplerParameters> kepler;
+    std::vector<KeplerSolverState> solver;
+    std::vector<uint8_t> perturbed;  // Same as BodyArrays::perturbed
+
+    // Absolute state cache, valid after a gather or a physics step
+    std::vector<double> ax, ay, az;
+    std::vector<double> avx, avy, avz;
+
+    // gx..gz were computed at the end of the last step, against these absolute body
+    // positions and masses. The next step's first half kick reuses them while nothing
+    // changed.
+    bool accelerationsValid = false;
+    std::vector<double> sourceX, sourceY, sourceZ, sourceM;
+
+    // Maps entt::to_entity(entity) to its index in the arrays, or -1
+    std::vector<int32_t> indexOf;
+
+    size_t size() const { return entity.size(); }
+    void resize(size_t n);
+};
+
+// Copies the registry state into the registry's TestParticleArrays context variable,
+// rebuilding the ordering if particles changed, and fills the absolute state cache.
+// Primaries are looked up in `bodies`, which must be gathered first.
+TestParticleArrays &gatherTestParticles(entt::registry &registry, const BodyArrays &bodies);
+
+// Returns the arrays as of the last gather or physics step, gathering them if the
+// registry has none yet
+const TestParticleArrays &getTestParticleArrays(entt::registry &registry);
+
+// Refills the absolute state cache from the relative states and the bodies' cache
+void calculateAbsoluteStates(TestParticleArrays &particles, const BodyArrays &bodies);
+
+inline Eigen::Vector3d absolutePosition(const TestParticleArrays &particles, entt::entity entity) {
+    int32_t i = particles.indexOf[entt::to_entity(entity)];
+    return Eigen::Vector3d(particles.ax[i], particles.ay[i], particles.az[i]);
+}
+
+// Copies positions, velocities and Kepler parameters back into the registry
+void scatterTestParticles(entt::registry &registry, const TestParticleArrays &particles);
+
+} // namespace sfs::physics
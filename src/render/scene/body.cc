@@ -5,10 +5,9 @@
 
 #include <glad/gl.h>
 
-#include "physics/kepler.h"
-#include "physics/physics.h"
 #include "render/gl/shader.h"
 #include "render/scene/camera.h"
+#include "render/scene/snapshot.h"
 
 namespace sfs::render {
 
@@ -117,7 +116,7 @@ void initRenderBodySystem() {
     initShaders();
 }
 
-void renderBodies(entt::registry &registry, entt::entity camera) {
+void renderBodies(const SceneSnapshot &scene, const SceneFrame &frame, const Camera &camera) {
     glEnable(GL_CULL_FACE);
     glCullFace(GL_BACK);
     glFrontFace(GL_CW);
@@ -127,19 +126,15 @@ void renderBodies(entt::registry &registry, entt::entity camera) {
     glBindBuffer(GL_ARRAY_BUFFER, bodyVBO);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bodyEBO);
 
-    auto &cameraData = registry.get<Camera>(camera);
-    glUniformMatrix4fv(body_uViewLoc, 1, GL_FALSE, cameraData.viewMatrix.data());
-    glUniformMatrix4fv(body_uProjectionLoc, 1, GL_FALSE, cameraData.projectionMatrix.data());
+    glUniformMatrix4fv(body_uViewLoc, 1, GL_FALSE, camera.viewMatrix.data());
+    glUniformMatrix4fv(body_uProjectionLoc, 1, GL_FALSE, camera.projectionMatrix.data());
 
-    auto view = registry.view<physics::BodyState, physics::KeplerParameters, RenderBody>();
-    for (auto entity : view) {
-        auto &bodyState = view.get<physics::BodyState>(entity);
-        auto &renderBody = view.get<RenderBody>(entity);
-        Eigen::Vector3d pos = calculateAbsolutePosition(registry, bodyState);
+    for (auto [item, radius] : scene.spheres) {
+        const Eigen::Vector3d &pos = frame.position[item];
 
         Eigen::Affine3f transform = Eigen::Affine3f::Identity();
         transform.translate(pos.cast<float>());
-        transform.scale(renderBody.radius * 1e3f);
+        transform.scale(radius * 1e3f);
         Eigen::Matrix4f modelMatrix = transform.matrix();
         glUniform3f(body_uPositionLoc, pos.x(), pos.y(), pos.z());
         glUniformMatrix4fv(body_uModelLoc, 1, GL_FALSE, modelMatrix.data());
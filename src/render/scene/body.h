@@ -4,11 +4,15 @@
 
 namespace sfs::render {
 
+struct Camera;
+struct SceneFrame;
+struct SceneSnapshot;
+
 struct RenderBody {
     float radius;
 };
 
 void initRenderBodySystem();
-void renderBodies(entt::registry &registry, entt::entity camera);
+void renderBodies(const SceneSnapshot &scene, const SceneFrame &frame, const Camera &camera);
 
 } // namespace sfs::render
@@ -5,7 +5,7 @@
 #include <Eigen/Dense>
 #include <GLFW/glfw3.h>
 
-#include "physics/physics.h"
+#include "render/scene/snapshot.h"
 
 namespace sfs::render {
 
@@ -95,7 +95,7 @@ void initCameraGLFWCallbacks(const MainWindow &window) {
     glfwSetKeyCallback(window.handle(), key_callback);
 }
 
-void updateCameras(entt::registry &registry, const MainWindow &window, double dt) {
+void updateCamera(Camera &camera, const SceneSnapshot &scene, const SceneFrame &frame, const MainWindow &window, double dt) {
     // TODO: less sus focus cycling
     constexpr int numCycle = 11;
     entt::entity focus = static_cast<entt::entity>((focusIndex % numCycle + numCycle) % numCycle);
@@ -116,35 +116,28 @@ void updateCameras(entt::registry &registry, const MainWindow &window, double dt
         dpitch = -kRotationSpeed;
     }
 
-    auto view = registry.view<Camera>();
-    for (auto entity : view) {
-        auto &camera = view.get<Camera>(entity);
+    camera.target = focus;
+    camera.distance = cameraDistance;
+    camera.yaw = fmod(camera.yaw + dyaw * dt, 2.0 * M_PI);
+    camera.pitch = std::clamp(camera.pitch + dpitch * dt, -0.49f * M_PI, 0.49f * M_PI);
 
-        camera.target = focus;
-        camera.distance = cameraDistance;
-        camera.yaw = fmod(camera.yaw + dyaw * dt, 2.0 * M_PI);
-        camera.pitch = std::clamp(camera.pitch + dpitch * dt, -0.49f * M_PI, 0.49f * M_PI);
+    float aspect = static_cast<float>(window.width()) / static_cast<float>(window.height());
+    camera.projectionMatrix = infinitePerspective(
+        45.0f * static_cast<float>(M_PI) / 180.0f,
+        aspect,
+        0.1f);
 
-        float aspect = static_cast<float>(window.width()) / static_cast<float>(window.height());
-        camera.projectionMatrix = infinitePerspective(
-            45.0f * static_cast<float>(M_PI) / 180.0f,
-            aspect,
-            0.1f);
+    if (camera.target == entt::null || scene.itemOf(camera.target) < 0) return;
 
-        if (camera.target == entt::null) continue;
+    Eigen::Vector3f targetPos = frame.positionOf(scene, camera.target).cast<float>();
+    float x = camera.distance * cosf(camera.pitch) * sinf(camera.yaw);
+    float y = camera.distance * sinf(camera.pitch);
+    float z = camera.distance * cosf(camera.pitch) * cosf(camera.yaw);
+    Eigen::Vector3f eye = targetPos + Eigen::Vector3f(x, y, z);
+    Eigen::Vector3f center = targetPos;
+    Eigen::Vector3f up(0.0f, 1.0f, 0.0f);
 
-        auto &targetState = registry.get<physics::BodyState>(camera.target);
-
-        Eigen::Vector3f targetPos = calculateAbsolutePosition(registry, targetState).cast<float>();
-        float x = camera.distance * cosf(camera.pitch) * sinf(camera.yaw);
-        float y = camera.distance * sinf(camera.pitch);
-        float z = camera.distance * cosf(camera.pitch) * cosf(camera.yaw);
-        Eigen::Vector3f eye = targetPos + Eigen::Vector3f(x, y, z);
-        Eigen::Vector3f center = targetPos;
-        Eigen::Vector3f up(0.0f, 1.0f, 0.0f);
-
-        camera.viewMatrix = lookAt(eye, center, up);
-    }
+    camera.viewMatrix = lookAt(eye, center, up);
 }
 
 } // namespace sfs::render
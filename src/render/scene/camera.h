@@ -7,6 +7,9 @@
 
 namespace sfs::render {
 
+struct SceneFrame;
+struct SceneSnapshot;
+
 struct Camera {
     entt::entity target;
     double distance;
@@ -17,6 +20,7 @@ struct Camera {
 };
 
 void initCameraGLFWCallbacks(const MainWindow &window);
-void updateCameras(entt::registry &registry, const MainWindow &window, double dt);
+// Follows the focused item of the snapshot, at its interpolated position in `frame`
+void updateCamera(Camera &camera, const SceneSnapshot &scene, const SceneFrame &frame, const MainWindow &window, double dt);
 
 } // namespace sfs::render
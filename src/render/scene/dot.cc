@@ -6,10 +6,9 @@
 #include <entt/entt.hpp>
 // clang-format on
 
-#include "physics/kepler.h"
-#include "physics/physics.h"
 #include "render/gl/shader.h"
 #include "render/scene/camera.h"
+#include "render/scene/snapshot.h"
 
 namespace sfs::render {
 
@@ -62,29 +61,25 @@ void initRenderDotSystem() {
     initShaders();
 }
 
-void renderDots(entt::registry &registry, entt::entity camera) {
+void renderDots(const SceneSnapshot &scene, const SceneFrame &frame, const Camera &camera) {
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     glUseProgram(dotShaderProgram);
     glBindVertexArray(dotVAO);
 
-    auto &cameraData = registry.get<Camera>(camera);
-    glUniformMatrix4fv(dot_uViewLoc, 1, GL_FALSE, cameraData.viewMatrix.data());
-    glUniformMatrix4fv(dot_uProjectionLoc, 1, GL_FALSE, cameraData.projectionMatrix.data());
+    glUniformMatrix4fv(dot_uViewLoc, 1, GL_FALSE, camera.viewMatrix.data());
+    glUniformMatrix4fv(dot_uProjectionLoc, 1, GL_FALSE, camera.projectionMatrix.data());
 
-    auto view = registry.view<physics::BodyState, RenderDot>();
     double lastSize = -1.0;
-    for (auto entity : view) {
-        auto &body = view.get<physics::BodyState>(entity);
-        auto &dot = view.get<RenderDot>(entity);
-        if (dot.size != lastSize) {
-            lastSize = dot.size;
-            glUniform1f(dot_uSizeLoc, dot.size);
+    for (auto [item, size] : scene.dots) {
+        if (size != lastSize) {
+            lastSize = size;
+            glUniform1f(dot_uSizeLoc, size);
         }
         // TODO: to avoid floating point error, we should calculate the position
         //  relative to the camera focus
-        Eigen::Vector3d pos = calculateAbsolutePosition(registry, body);
+        const Eigen::Vector3d &pos = frame.position[item];
         glUniform3f(dot_uPositionLoc, pos.x(), pos.y(), pos.z());
         glDrawArrays(GL_TRIANGLES, 0, 6);
     }
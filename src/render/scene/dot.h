@@ -4,11 +4,15 @@
 
 namespace sfs::render {
 
+struct Camera;
+struct SceneFrame;
+struct SceneSnapshot;
+
 struct RenderDot {
     float size;
 };
 
 void initRenderDotSystem();
-void renderDots(entt::registry &registry, entt::entity camera);
+void renderDots(const SceneSnapshot &scene, const SceneFrame &frame, const Camera &camera);
 
 } // namespace sfs::render
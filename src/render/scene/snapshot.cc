@@ -0,0 +1,95 @@
+#include "snapshot.h"
+
+#include <algorithm>
+
+#include "physics/body_arrays.h"
+#include "physics/physics.h"
+#include "physics/test_particles.h"
+#include "render/scene/body.h"
+#include "render/scene/dot.h"
+#include "render/scene/trajectory.h"
+
+namespace sfs::render {
+
+void captureScene(entt::registry &registry, uint64_t step, double time, SceneHistory &history, SceneSnapshot &scene) {
+    const auto &bodies = physics::getBodyArrays(registry);
+    const auto &particles = physics::getTestParticleArrays(registry);
+    size_t n = bodies.size() + particles.size();
+
+    scene.entity.resize(n);
+    scene.position.resize(n);
+    scene.velocity.resize(n);
+    for (size_t i = 0; i < bodies.size(); i++) {
+        scene.entity[i] = bodies.entity[i];
+        scene.position[i] = Eigen::Vector3d(bodies.ax[i], bodies.ay[i], bodies.az[i]);
+        scene.velocity[i] = Eigen::Vector3d(bodies.avx[i], bodies.avy[i], bodies.avz[i]);
+    }
+    for (size_t k = 0; k < particles.size(); k++) {
+        size_t i = bodies.size() + k;
+        scene.entity[i] = particles.entity[k];
+        scene.position[i] = Eigen::Vector3d(particles.ax[k], particles.ay[k], particles.az[k]);
+        scene.velocity[i] = Eigen::Vector3d(particles.avx[k], particles.avy[k], particles.avz[k]);
+    }
+    scene.indexOf.assign(std::max(bodies.indexOf.size(), particles.indexOf.size()), -1);
+    for (size_t i = 0; i < n; i++) scene.indexOf[entt::to_entity(scene.entity[i])] = static_cast<int32_t>(i);
+
+    auto now = std::chrono::steady_clock::now();
+    scene.step = step;
+    scene.time = time;
+    scene.publishedAt = now;
+    if (history.started && history.entity == scene.entity) {
+        scene.previousTime = history.time;
+        scene.previousPosition = history.position;
+        scene.previousVelocity = history.velocity;
+        scene.wallInterval = std::chrono::duration<double>(now - history.publishedAt).count();
+    } else {
+        scene.previousTime = time;
+        scene.previousPosition = scene.position;
+        scene.previousVelocity = scene.velocity;
+        scene.wallInterval = 0.0;
+    }
+    history.started = true;
+    history.time = time;
+    history.publishedAt = now;
+    history.entity = scene.entity;
+    history.position = scene.position;
+    history.velocity = scene.velocity;
+
+    scene.spheres.clear();
+    auto bodyView = registry.view<physics::BodyState, physics::KeplerParameters, RenderBody>();
+    for (auto entity : bodyView) {
+        int32_t i = scene.itemOf(entity);
+        if (i >= 0) scene.spheres.emplace_back(i, bodyView.get<RenderBody>(entity).radius);
+    }
+    scene.dots.clear();
+    auto dotView = registry.view<physics::BodyState, RenderDot>();
+    for (auto entity : dotView) {
+        int32_t i = scene.itemOf(entity);
+        if (i >= 0) scene.dots.emplace_back(i, dotView.get<RenderDot>(entity).size);
+    }
+    scene.trajectories.clear();
+    auto trajectoryView = registry.view<physics::BodyState, physics::KeplerParameters, RenderTrajectory>();
+    for (auto entity : trajectoryView) {
+        auto primary = trajectoryView.get<physics::BodyState>(entity).st.primary;
+        int32_t p = primary == entt::null ? -1 : scene.itemOf(primary);
+        if (p >= 0) scene.trajectories.push_back(SceneTrajectory{ entity, static_cast<uint32_t>(p), trajectoryView.get<physics::KeplerParameters>(entity) });
+    }
+}
+
+void interpolateScene(const SceneSnapshot &scene, std::chrono::steady_clock::time_point now, SceneFrame &frame) {
+    double s = 1.0;
+    if (scene.wallInterval > 0.0) s = std::clamp(std::chrono::duration<double>(now - scene.publishedAt).count() / scene.wallInterval, 0.0, 1.0);
+    double h = scene.time - scene.previousTime;
+    frame.time = scene.previousTime + s * h;
+
+    // Hermite basis functions
+    double s2 = s * s, s3 = s2 * s;
+    double h00 = 2.0 * s3 - 3.0 * s2 + 1.0, h10 = (s3 - 2.0 * s2 + s) * h;
+    double h01 = -2.0 * s3 + 3.0 * s2, h11 = (s3 - s2) * h;
+    frame.position.resize(scene.entity.size());
+    for (size_t i = 0; i < scene.entity.size(); i++) {
+        frame.position[i] = h00 * scene.previousPosition[i] + h10 * scene.previousVelocity[i] + h01 * scene.position[i] + h11 * scene.velocity[i];
+    }
+}
+
+} // namespace sfs::render
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <entt/entt.hpp>
+
+#include "physics/kepler.h"
+
+namespace sfs::render {
+
+// Conic to draw about the item `primary`
+struct SceneTrajectory {
+    entt::entity entity;
+    uint32_t primary;
+    physics::KeplerParameters kepler;
+};
+
+// Everything the render systems draw, as of the last step of one simulation tick.
+// Published by the simulation thread so that rendering never touches the registry.
+//
+// Items are the bodies, then the test particles, with their absolute states now and as
+// of the previous snapshot, for interpolation. Both are the same after the items
+// changed.
+struct SceneSnapshot {
+    uint64_t step = 0;
+    double time = 0.0;          // Simulated time of the current states
+    double previousTime = 0.0;  // Simulated time of the previous states
+    std::chrono::steady_clock::time_point publishedAt{};
+    double wallInterval = 0.0;  // Wall-clock seconds since the previous states were published
+
+    // Time warp of the simulation thread, in simulated seconds per wall-clock second
+    double targetWarp = 0.0;
+    double achievedWarp = 0.0;
+    bool computeLimited = false;  // The last tick ran out of budget and dropped its backlog
+
+    std::vector<entt::entity> entity;
+    std::vector<int32_t> indexOf;  // Maps entt::to_entity(entity) to its item, or -1
+    std::vector<Eigen::Vector3d> position, velocity;
+    std::vector<Eigen::Vector3d> previousPosition, previousVelocity;
+
+    std::vector<std::pair<uint32_t, float>> spheres;  // Items with a RenderBody, and its radius
+    std::vector<std::pair<uint32_t, float>> dots;     // Items with a RenderDot, and its size
+    std::vector<SceneTrajectory> trajectories;        // Items with a RenderTrajectory and a primary
+
+    int32_t itemOf(entt::entity e) const {
+        auto id = entt::to_entity(e);
+        return id < indexOf.size() ? indexOf[id] : -1;
+    }
+};
+
+// States the simulation thread last published, which become the next snapshot's
+// previous ones
+struct SceneHistory {
+    bool started = false;
+    double time = 0.0;
+    std::chrono::steady_clock::time_point publishedAt{};
+    std::vector<entt::entity> entity;
+    std::vector<Eigen::Vector3d> position, velocity;
+};
+
+// Fills `scene` from the registry at simulated `time`, and records its states in
+// `history`. Reads the absolute state caches, so call it after physicsUpdate.
+void captureScene(entt::registry &registry, uint64_t step, double time, SceneHistory &history, SceneSnapshot &scene);
+
+// Positions of a snapshot's items at one instant between its two states
+struct SceneFrame {
+    double time = 0.0;
+    std::vector<Eigen::Vector3d> position;
+
+    Eigen::Vector3d positionOf(const SceneSnapshot &scene, entt::entity e) const {
+        int32_t i = scene.itemOf(e);
+        return i < 0 ? Eigen::Vector3d::Zero() : position[i];
+    }
+};
+
+// Interpolates the snapshot at wall-clock `now` along each item's cubic Hermite arc. The
+// wall-clock time since publication is mapped onto the simulated time since the previous
+// snapshot, so the picture runs one snapshot behind the simulation and reaches the
+// current states just as the next one is due.
+void interpolateScene(const SceneSnapshot &scene, std::chrono::steady_clock::time_point now, SceneFrame &frame);
+
+} // namespace sfs::render
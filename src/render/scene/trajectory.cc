@@ -6,10 +6,15 @@
 #include <entt/entt.hpp>
 // clang-format on
 
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <vector>
+
 #include "physics/kepler.h"
-#include "physics/physics.h"
 #include "render/gl/shader.h"
 #include "render/scene/camera.h"
+#include "render/scene/snapshot.h"
 
 namespace sfs::render {
 
@@ -18,13 +23,98 @@ namespace {
 extern "C" const char EMBED_START_ASSETS_TRAJ_VERT_GLSL[];
 extern "C" const char EMBED_START_ASSETS_TRAJ_FRAG_GLSL[];
 
+constexpr int kPointsPerOrbit = 250;
+constexpr GLsizeiptr kSlotBytes = kPointsPerOrbit * 3 * sizeof(float);
+constexpr size_t kInitialSlots = 64;
+// Relative change of the conic below which a cached orbit is kept. An orbit filling the
+// screen then moves by about a fifth of a pixel before it is resampled.
+constexpr double kShapeTolerance = 1e-4;
+
 GLuint trajectoryVAO, trajectoryVBO;
+GLuint primaryBuffer, primaryTexture;
 GLuint trajectoryShaderProgram;
-GLuint trajectory_uPositionLoc, trajectory_uViewLoc, trajectory_uProjectionLoc;
+GLuint trajectory_uPrimaryPositionsLoc, trajectory_uPointsPerOrbitLoc, trajectory_uViewLoc, trajectory_uProjectionLoc;
+
+// Conic elements an orbit was sampled for
+struct ConicShape {
+    Eigen::Vector3d h;   // Specific angular momentum
+    Eigen::Vector3d e;   // Eccentricity vector
+    double alpha;        // 1 / a
+    Eigen::Vector3d r0;  // Start of the drawn arc, which only matters for open orbits
+};
+
+// Every orbit owns a slot of kPointsPerOrbit vertices in the shared vertex buffer, and
+// the same slot of the primary position buffer, which the vertex shader indexes by
+// gl_VertexID / kPointsPerOrbit. All orbits are then drawn with one multi-draw call.
+struct CachedTrajectory {
+    ConicShape shape;
+    bool sampled = false;
+    uint32_t slot = 0;
+    uint64_t lastFrame = 0;
+};
+
+struct TrajectoryCache {
+    std::unordered_map<entt::entity, CachedTrajectory> entries;
+    std::vector<uint32_t> freeSlots;
+    size_t slotCount = 0;  // Slots handed out, including the free ones
+    size_t capacity = 0;   // Slots allocated in the buffers
+    uint64_t frame = 0;
+
+    // Per-frame scratch
+    std::vector<float> primaryPositions;  // 4 floats per slot
+    std::vector<GLint> firsts;
+    std::vector<GLsizei> counts;
+    std::vector<Eigen::Vector3d> points;
+    std::vector<float> vertices;
+};
+
+TrajectoryCache cache;
+
+ConicShape conicShape(const physics::KeplerParameters &p) {
+    Eigen::Vector3d h = p.r0.cross(p.v0);
+    Eigen::Vector3d e = p.v0.cross(h) / p.mu - p.r0 / p.r0_norm;
+    return ConicShape{ h, e, p.alpha, p.r0 };
+}
+
+bool sameShape(const ConicShape &a, const ConicShape &b) {
+    if ((a.h - b.h).norm() > kShapeTolerance * a.h.norm()) return false;
+    if ((a.e - b.e).norm() > kShapeTolerance) return false;
+    if (std::fabs(a.alpha - b.alpha) > kShapeTolerance * std::fabs(a.alpha)) return false;
+    return a.alpha > 0.0 || (a.r0 - b.r0).norm() <= kShapeTolerance * a.r0.norm();
+}
+
+// Reallocates both buffers for at least `slots` slots. Their contents are lost, so every
+// cached orbit is resampled.
+void reserveSlots(size_t slots) {
+    if (slots <= cache.capacity) return;
+    cache.capacity = std::max({ slots, 2 * cache.capacity, kInitialSlots });
+    glBindBuffer(GL_ARRAY_BUFFER, trajectoryVBO);
+    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(cache.capacity) * kSlotBytes, nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, primaryBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, static_cast<GLsizeiptr>(cache.capacity * 4 * sizeof(float)), nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    cache.primaryPositions.resize(cache.capacity * 4);
+    for (auto &[entity, entry] : cache.entries) entry.sampled = false;
+}
+
+void sampleIntoSlot(const physics::KeplerParameters &kepler, uint32_t slot) {
+    cache.points.clear();
+    physics::sampleTrajectoryPoints(kepler, cache.points, kPointsPerOrbit);
+    cache.vertices.clear();
+    for (const auto &pt : cache.points) {
+        cache.vertices.push_back(static_cast<float>(pt.x()));
+        cache.vertices.push_back(static_cast<float>(pt.y()));
+        cache.vertices.push_back(static_cast<float>(pt.z()));
+    }
+    glBufferSubData(GL_ARRAY_BUFFER, static_cast<GLintptr>(slot) * kSlotBytes, kSlotBytes, cache.vertices.data());
+}
 
 void initTrajectoryBuffers() {
     glGenVertexArrays(1, &trajectoryVAO);
     glGenBuffers(1, &trajectoryVBO);
+    glGenBuffers(1, &primaryBuffer);
+    glGenTextures(1, &primaryTexture);
+    reserveSlots(kInitialSlots);
 
     glBindVertexArray(trajectoryVAO);
     glBindBuffer(GL_ARRAY_BUFFER, trajectoryVBO);
@@ -33,6 +123,11 @@ void initTrajectoryBuffers() {
 
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
+
+    // NB: The texture follows the buffer's storage through reallocations
+    glBindTexture(GL_TEXTURE_BUFFER, primaryTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, primaryBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
 }
 
 void initShaders() {
@@ -43,9 +138,12 @@ void initShaders() {
     }
 
     glUseProgram(trajectoryShaderProgram);
-    trajectory_uPositionLoc = glGetUniformLocation(trajectoryShaderProgram, "uPosition");
+    trajectory_uPrimaryPositionsLoc = glGetUniformLocation(trajectoryShaderProgram, "uPrimaryPositions");
+    trajectory_uPointsPerOrbitLoc = glGetUniformLocation(trajectoryShaderProgram, "uPointsPerOrbit");
     trajectory_uViewLoc = glGetUniformLocation(trajectoryShaderProgram, "uView");
     trajectory_uProjectionLoc = glGetUniformLocation(trajectoryShaderProgram, "uProjection");
+    glUniform1i(trajectory_uPrimaryPositionsLoc, 0);
+    glUniform1i(trajectory_uPointsPerOrbitLoc, kPointsPerOrbit);
     glUseProgram(0);
 }
 
@@ -56,55 +154,73 @@ void initRenderTrajectorySystem() {
     initShaders();
 }
 
-void renderTrajectories(entt::registry &registry, entt::entity camera) {
-    glLineWidth(1.0f);
+void renderTrajectories(const SceneSnapshot &scene, const SceneFrame &frame, const Camera &camera) {
+    // Hand out slots to new orbits, then free the slots of the ones that are gone
+    cache.frame++;
+    for (const auto &trajectory : scene.trajectories) {
+        auto [it, inserted] = cache.entries.try_emplace(trajectory.entity);
+        if (inserted) {
+            if (cache.freeSlots.empty()) {
+                it->second.slot = static_cast<uint32_t>(cache.slotCount++);
+            } else {
+                it->second.slot = cache.freeSlots.back();
+                cache.freeSlots.pop_back();
+            }
+        }
+        it->second.lastFrame = cache.frame;
+    }
+    for (auto it = cache.entries.begin(); it != cache.entries.end();) {
+        if (it->second.lastFrame == cache.frame) {
+            ++it;
+            continue;
+        }
+        cache.freeSlots.push_back(it->second.slot);
+        it = cache.entries.erase(it);
+    }
+    reserveSlots(cache.slotCount);
 
-    glUseProgram(trajectoryShaderProgram);
-    glBindVertexArray(trajectoryVAO);
+    // Only orbits whose shape changed are resampled; the rest just follow their primary
     glBindBuffer(GL_ARRAY_BUFFER, trajectoryVBO);
-
-    auto &cameraData = registry.get<Camera>(camera);
-    glUniformMatrix4fv(trajectory_uViewLoc, 1, GL_FALSE, cameraData.viewMatrix.data());
-    glUniformMatrix4fv(trajectory_uProjectionLoc, 1, GL_FALSE, cameraData.projectionMatrix.data());
-
-    constexpr int n = 250;
-    auto view = registry.view<physics::BodyState, physics::KeplerParameters, RenderTrajectory>();
-    std::vector<Eigen::Vector3d> points;
-    points.reserve(n);
-    std::vector<float> bufferData;
-    bufferData.reserve(3 * n);
-    for (auto entity : view) {
-        auto &state = view.get<physics::BodyState>(entity);
-        if (state.st.primary == entt::null) continue;
-
-        auto &primaryState = view.get<physics::BodyState>(state.st.primary);
-        auto &p = view.get<physics::KeplerParameters>(entity);
-        points.clear();
-        sampleTrajectoryPoints(p, points, n);
-
-        bufferData.clear();
-        for (const auto &pt : points) {
-            bufferData.push_back(static_cast<float>(pt.x()));
-            bufferData.push_back(static_cast<float>(pt.y()));
-            bufferData.push_back(static_cast<float>(pt.z()));
+    cache.firsts.clear();
+    cache.counts.clear();
+    for (const auto &trajectory : scene.trajectories) {
+        auto &entry = cache.entries[trajectory.entity];
+        ConicShape shape = conicShape(trajectory.kepler);
+        if (!entry.sampled || !sameShape(entry.shape, shape)) {
+            sampleIntoSlot(trajectory.kepler, entry.slot);
+            entry.shape = shape;
+            entry.sampled = true;
         }
-        glBufferData(GL_ARRAY_BUFFER, bufferData.size() * sizeof(float), bufferData.data(), GL_DYNAMIC_DRAW);
 
         // TODO: to avoid floating point error, we should calculate the position
         //  relative to the camera focus
-        Eigen::Vector3d primaryPos = calculateAbsolutePosition(registry, primaryState);
-        glUniform3f(trajectory_uPositionLoc, primaryPos.x(), primaryPos.y(), primaryPos.z());
-        glDrawArrays(GL_LINE_STRIP, 0, points.size());
-
-        // glBegin(GL_LINE_STRIP);
-        // for (const auto &pt : points) {
-        //     Eigen::Vector3d screenPos = (primaryState.st.pos + pt) * kRenderScale;
-        //     glVertex2d(screenPos.x(), screenPos.y());
-        // }
-        // glEnd();
+        const Eigen::Vector3d &primaryPos = frame.position[trajectory.primary];
+        float *position = &cache.primaryPositions[4 * entry.slot];
+        position[0] = static_cast<float>(primaryPos.x());
+        position[1] = static_cast<float>(primaryPos.y());
+        position[2] = static_cast<float>(primaryPos.z());
+        cache.firsts.push_back(static_cast<GLint>(entry.slot) * kPointsPerOrbit);
+        cache.counts.push_back(kPointsPerOrbit);
     }
-
     glBindBuffer(GL_ARRAY_BUFFER, 0);
+    if (cache.firsts.empty()) return;
+
+    glBindBuffer(GL_TEXTURE_BUFFER, primaryBuffer);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, static_cast<GLsizeiptr>(cache.slotCount * 4 * sizeof(float)), cache.primaryPositions.data());
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    glLineWidth(1.0f);
+
+    glUseProgram(trajectoryShaderProgram);
+    glBindVertexArray(trajectoryVAO);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, primaryTexture);
+
+    glUniformMatrix4fv(trajectory_uViewLoc, 1, GL_FALSE, camera.viewMatrix.data());
+    glUniformMatrix4fv(trajectory_uProjectionLoc, 1, GL_FALSE, camera.projectionMatrix.data());
+    glMultiDrawArrays(GL_LINE_STRIP, cache.firsts.data(), cache.counts.data(), static_cast<GLsizei>(cache.firsts.size()));
+
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
     glBindVertexArray(0);
     glUseProgram(0);
 }
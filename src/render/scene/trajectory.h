@@ -4,9 +4,13 @@
 
 namespace sfs::render {
 
+struct Camera;
+struct SceneFrame;
+struct SceneSnapshot;
+
 struct RenderTrajectory { };
 
 void initRenderTrajectorySystem();
-void renderTrajectories(entt::registry &registry, entt::entity camera);
+void renderTrajectories(const SceneSnapshot &scene, const SceneFrame &frame, const Camera &camera);
 
 } // namespace sfs::render
@@ -0,0 +1,93 @@
+#include "simulation_thread.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <utility>
+
+#include "model/checkpoint.h"
+#include "physics/physics.h"
+
+namespace sfs {
+
+namespace {
+
+constexpr double kTicksPerSecond = 60.0;
+constexpr double kDefaultBudget = 0.75 / kTicksPerSecond;  // Leaves a quarter of each tick idle
+constexpr double kWarpSmoothing = 0.5;                     // Seconds
+
+} // namespace
+
+SimulationThread::SimulationThread(entt::registry &registry, double time, double dt, double warp)
+    : registry_(registry), startTime_(time), dt_(dt), warp_(warp), budget_(kDefaultBudget) {
+    publish(false);
+    thread_ = std::thread(&SimulationThread::run, this);
+}
+
+SimulationThread::~SimulationThread() {
+    stop_.store(true, std::memory_order_relaxed);
+    thread_.join();
+}
+
+void SimulationThread::requestCheckpoint(const std::string &path) {
+    std::lock_guard lock(requestMutex_);
+    checkpointPath_ = path;
+}
+
+void SimulationThread::run() {
+    using Clock = std::chrono::steady_clock;
+    auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / kTicksPerSecond));
+    auto last = Clock::now(), next = last;
+    while (!stop_.load(std::memory_order_relaxed)) {
+        auto start = Clock::now();
+        double elapsed = std::chrono::duration<double>(start - last).count();
+        last = start;
+        serveRequests();
+
+        accumulator_ += warp() * elapsed;
+        auto deadline = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(budget()));
+        uint64_t first = step_;
+        while (accumulator_ >= dt_ && !stop_.load(std::memory_order_relaxed)) {
+            physics::physicsUpdate(registry_, dt_);
+            step_++;
+            accumulator_ -= dt_;
+            if (Clock::now() >= deadline) break;
+        }
+        // Keeps the fraction of a step still owed, so that reachable warps stay exact
+        bool computeLimited = accumulator_ >= dt_;
+        if (computeLimited) accumulator_ = std::fmod(accumulator_, dt_);
+
+        if (elapsed > 0.0) {
+            double weight = std::min(1.0, elapsed / kWarpSmoothing);
+            achievedWarp_ += weight * (static_cast<double>(step_ - first) * dt_ / elapsed - achievedWarp_);
+        }
+        if (diagnosticsVisible_.load(std::memory_order_relaxed)) diagnostics_.update(registry_);
+        if (step_ != first) publish(computeLimited);
+
+        next += period;
+        auto now = Clock::now();
+        if (next < now) next = now;
+        std::this_thread::sleep_until(next);
+    }
+}
+
+void SimulationThread::serveRequests() {
+    std::string path;
+    {
+        std::lock_guard lock(requestMutex_);
+        std::swap(path, checkpointPath_);
+    }
+    if (!path.empty() && !model::saveCheckpoint(registry_, path, time())) std::cerr << "Failed to save " << path << std::endl;
+}
+
+void SimulationThread::publish(bool computeLimited) {
+    auto &scene = scenes_.back();
+    render::captureScene(registry_, step_, time(), history_, scene);
+    scene.targetWarp = warp();
+    scene.achievedWarp = achievedWarp_;
+    scene.computeLimited = computeLimited;
+    scenes_.publish();
+}
+
+} // namespace sfs
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <entt/entt.hpp>
+
+#include "physics/diagnostics.h"
+#include "render/scene/snapshot.h"
+#include "triple_buffer.h"
+
+namespace sfs {
+
+// Runs physicsUpdate on its own thread, independent of the display.
+//
+// The thread wakes at a fixed rate of ticks per wall-clock second. Each tick adds the
+// warp times the wall-clock time since the last one to an accumulator. It then runs
+// fixed steps of dt while the accumulator holds one, until the tick's compute budget is
+// spent. Backlog the budget could not clear is dropped, so an unreachable warp slows the
+// simulation down instead of piling up work. A SceneSnapshot is published after every
+// tick that stepped.
+//
+// The thread owns the registry from construction to destruction; the render thread only
+// reads snapshots, and everything else that needs the registry goes through requests
+// that are served between ticks.
+class SimulationThread {
+public:
+    // Publishes the initial scene, then starts stepping by `dt` from simulated `time`
+    // at `warp` simulated seconds per wall-clock second
+    SimulationThread(entt::registry &registry, double time, double dt, double warp);
+    ~SimulationThread();
+
+    SimulationThread(const SimulationThread &) = delete;
+    SimulationThread &operator=(const SimulationThread &) = delete;
+
+    // Reader side belongs to the render thread
+    TripleBuffer<render::SceneSnapshot> &scenes() { return scenes_; }
+
+    // Updated between ticks while visible
+    physics::ConservedQuantityMonitor &diagnostics() { return diagnostics_; }
+    void setDiagnosticsVisible(bool visible) { diagnosticsVisible_.store(visible, std::memory_order_relaxed); }
+
+    // Saves a checkpoint after the current tick. Failures are reported on stderr.
+    void requestCheckpoint(const std::string &path);
+
+    // Target simulated seconds per wall-clock second, 0 to pause
+    double warp() const { return warp_.load(std::memory_order_relaxed); }
+    void setWarp(double warp) { warp_.store(warp, std::memory_order_relaxed); }
+
+    // Wall-clock seconds of stepping per tick
+    double budget() const { return budget_.load(std::memory_order_relaxed); }
+    void setBudget(double seconds) { budget_.store(seconds, std::memory_order_relaxed); }
+
+private:
+    void run();
+    void serveRequests();
+    void publish(bool computeLimited);
+
+    // Steps are counted rather than summed, so the time carries no accumulated rounding
+    double time() const { return startTime_ + static_cast<double>(step_) * dt_; }
+
+    entt::registry &registry_;
+    double startTime_;
+    double dt_;
+    uint64_t step_ = 0;
+
+    std::atomic<double> warp_;
+    std::atomic<double> budget_;
+    double accumulator_ = 0.0;   // Simulated seconds owed
+    double achievedWarp_ = 0.0;  // Smoothed over about kWarpSmoothing seconds
+
+    TripleBuffer<render::SceneSnapshot> scenes_;
+    render::SceneHistory history_;
+    physics::ConservedQuantityMonitor diagnostics_;
+    std::atomic<bool> diagnosticsVisible_{ false };
+
+    std::mutex requestMutex_;
+    std::string checkpointPath_;  // Empty if none is requested
+
+    std::atomic<bool> stop_{ false };
+    std::thread thread_;
+};
+
+} // namespace sfs
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Hands the latest of a stream of values from one writer thread to one reader thread
+// without locks. The writer fills its back slot and publishes it by swapping it with the
+// middle slot; the reader swaps the middle slot with its front slot when it holds
+// something newer. Neither ever waits for the other, and values the reader was too
+// slow for are overwritten, so it always sees the newest one.
+//
+// Slots are reused, so the writer's slot holds a stale value from three publishes ago.
+template<typename T>
+class TripleBuffer {
+public:
+    // Writer side
+    T &back() { return slots_[back_]; }
+    void publish() { back_ = middle_.exchange(back_ | kFresh, std::memory_order_acq_rel) & kIndex; }
+
+    // Reader side. Swaps in the newest published value, if there is one since the last
+    // call, and returns whether it did.
+    bool update() {
+        if (!(middle_.load(std::memory_order_relaxed) & kFresh)) return false;
+        front_ = middle_.exchange(front_, std::memory_order_acq_rel) & kIndex;
+        return true;
+    }
+    const T &front() const { return slots_[front_]; }
+
+private:
+    static constexpr uint8_t kIndex = 3;
+    static constexpr uint8_t kFresh = 4;  // Middle slot was published and not yet read
+
+    T slots_[3];
+    uint8_t back_ = 0;
+    std::atomic<uint8_t> middle_{ 1 };
+    uint8_t front_ = 2;
+};